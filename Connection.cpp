@@ -30,6 +30,8 @@ typedef int ssize_t;
 #endif
 
 #include "Connection.hpp"
+#include "Log.hpp"
+#include "Metrics.hpp"
 
 //------------------------------------------------------
 
@@ -93,7 +95,7 @@ void poll_connections(
 		int ret = select(max + 1, &read_fds, &write_fds, NULL, &tv);
 
 		if (ret < 0) {
-			std::cerr << "[" << where << "] Select returned an error; will attempt to read/write anyway." << std::endl;
+			Log::warn("[{}] Select returned an error; will attempt to read/write anyway.", where);
 		} else if (ret == 0) {
 			//nothing to read or write.
 			return;
@@ -114,7 +116,7 @@ void poll_connections(
 			#endif
 				connections.emplace_back();
 				connections.back().socket = got;
-				std::cerr << "[" << where << "] client connected on " << connections.back().socket << "." << std::endl; //INFO
+				Log::info("[{}] client connected on {}.", where, connections.back().socket);
 				if (on_event) on_event(&connections.back(), Connection::OnOpen);
 			}
 		}
@@ -123,6 +125,9 @@ void poll_connections(
 	const uint32_t BufferSize = 20000;
 	static thread_local char *buffer = new char[BufferSize];
 
+	static Metrics::Counter &bytes_received = Metrics::counter("net_bytes_received_total", "Bytes received over all connections.");
+	static Metrics::Counter &bytes_sent = Metrics::counter("net_bytes_sent_total", "Bytes sent over all connections.");
+
 	//process requests:
 	for (auto &c : connections) {
 		//only read from valid sockets marked readable:
@@ -134,15 +139,16 @@ void poll_connections(
 		} else if (ret <= 0 || ret > (ssize_t)BufferSize) {
 			//~problem~ so remove connection
 			if (ret == 0) {
-				std::cerr << "[" << where << "] port closed, disconnecting." << std::endl;
+				Log::warn("[{}] port closed, disconnecting.", where);
 			} else if (ret < 0) {
-				std::cerr << "[" << where << "] recv() returned error " << errno << "(" << strerror(errno) << "), disconnecting." << std::endl;
+				Log::warn("[{}] recv() returned error {}({}), disconnecting.", where, errno, strerror(errno));
 			} else {
-				std::cerr << "[" << where << "] recv() returned strange number of bytes, disconnecting." << std::endl;
+				Log::warn("[{}] recv() returned strange number of bytes, disconnecting.", where);
 			}
 			c.close();
 			if (on_event) on_event(&c, Connection::OnClose);
 		} else { //ret > 0
+			bytes_received.add(uint64_t(ret));
 			c.recv_buffer.insert(c.recv_buffer.end(), buffer, buffer + ret);
 			if (on_event) on_event(&c, Connection::OnRecv);
 		}
@@ -163,13 +169,14 @@ void poll_connections(
 			break;
 		} else if (ret <= 0 || ret > (ssize_t)c.send_buffer.size()) {
 			if (ret < 0) {
-				std::cerr << "[" << where << "] send() returned error " << errno << ", disconnecting." << std::endl;
+				Log::warn("[{}] send() returned error {}, disconnecting.", where, errno);
 			} else { assert(ret == 0 || ret > (ssize_t)c.send_buffer.size());
-				std::cerr << "[" << where << "] send() returned strange number of bytes [" << ret << " of " << c.send_buffer.size() << "], disconnecting." << std::endl;
+				Log::warn("[{}] send() returned strange number of bytes [{} of {}], disconnecting.", where, ret, c.send_buffer.size());
 			}
 			c.close();
 			if (on_event) on_event(&c, Connection::OnClose);
 		} else { //ret seems reasonable
+			bytes_sent.add(uint64_t(ret));
 			c.send_buffer.erase(c.send_buffer.begin(), c.send_buffer.begin() + ret);
 		}
 	}
@@ -180,7 +187,7 @@ void poll_connections(
 //---------------------------------
 
 
-Server::Server(std::string const &port) {
+Server::Server(std::string const &port, std::string const &host) {
 
 	#ifdef _WIN32
 	{ //init winsock:
@@ -196,10 +203,10 @@ Server::Server(std::string const &port) {
 		memset(&hints, 0, sizeof(hints));
 		hints.ai_family = AF_UNSPEC;
 		hints.ai_socktype = SOCK_STREAM;
-		hints.ai_flags = AI_PASSIVE;
+		hints.ai_flags = (host.empty() ? AI_PASSIVE : 0);
 
 		struct addrinfo *res = nullptr;
-		int ret = getaddrinfo(NULL, port.c_str(), &hints, &res);
+		int ret = getaddrinfo(host.empty() ? NULL : host.c_str(), port.c_str(), &hints, &res);
 		if (ret != 0) {
 			throw std::runtime_error("getaddrinfo error: " + std::string(gai_strerror(ret)));
 		}
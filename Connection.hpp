@@ -88,6 +88,9 @@ struct Connection {
 	//When the connection receives data, it is appended to recv_buffer:
 	std::vector< char > recv_buffer;
 
+	//Free for the application to use (e.g., to point at whatever the connection belongs to):
+	void *user_data = nullptr;
+
 	//internals:
 	Socket socket = InvalidSocket;
 
@@ -99,7 +102,7 @@ struct Connection {
 };
 
 struct Server {
-	Server(std::string const &port); //pass the port number to listen on, as a string (servname, really)
+	Server(std::string const &port, std::string const &host = ""); //pass the port number to listen on, as a string (servname, really); pass a host to listen only on that address (e.g. "127.0.0.1")
 
 	//poll() updates the list of active connections and provides information to your callbacks:
 	void poll(
@@ -0,0 +1,35 @@
+#include "FreeTileIndex.hpp"
+
+#include <cassert>
+
+FreeTileIndex::FreeTileIndex(uint32_t width_, uint32_t height_, std::pmr::memory_resource *memory) : width(width_), height(height_), tiles(memory), slot(memory) {
+	slot.assign(width * height, NotFree);
+	tiles.reserve(width * height);
+}
+
+void FreeTileIndex::insert(uint32_t tile) {
+	assert(tile < slot.size());
+	if (slot[tile] != NotFree) return;
+	slot[tile] = uint32_t(tiles.size());
+	tiles.emplace_back(tile);
+}
+
+void FreeTileIndex::erase(uint32_t tile) {
+	assert(tile < slot.size());
+	uint32_t at = slot[tile];
+	if (at == NotFree) return;
+	uint32_t last = tiles.back();
+	tiles[at] = last;
+	slot[last] = at;
+	tiles.pop_back();
+	slot[tile] = NotFree;
+}
+
+void FreeTileIndex::insert_rect(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1) {
+	assert(x1 <= width && y1 <= height);
+	for (uint32_t y = y0; y < y1; ++y) {
+		for (uint32_t x = x0; x < x1; ++x) {
+			insert(y * width + x);
+		}
+	}
+}
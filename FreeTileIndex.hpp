@@ -0,0 +1,44 @@
+#pragma once
+
+/*
+ * FreeTileIndex tracks the set of free (unowned, in-bounds) tiles on a
+ * board so that a uniformly random free tile can be picked in O(1).
+ *
+ * Tiles are stored densely in 'tiles', and 'slot' maps each tile back
+ * to its position in 'tiles' so that insert/erase are also O(1)
+ * (erase swaps the last tile into the hole).
+ *
+ * Tiles are identified by their row-major index: y * width + x.
+ *
+ * Storage comes from 'memory' (e.g., the owning game's arena), and is
+ * allocated once, up front, by the constructor.
+ */
+
+#include "Rng.hpp"
+
+#include <vector>
+#include <memory_resource>
+#include <cstdint>
+
+struct FreeTileIndex {
+	FreeTileIndex(uint32_t width = 0, uint32_t height = 0, std::pmr::memory_resource *memory = std::pmr::get_default_resource()); //starts with no free tiles
+
+	uint32_t width, height;
+
+	void insert(uint32_t tile); //(does nothing if already free)
+	void erase(uint32_t tile); //(does nothing if not free)
+	bool contains(uint32_t tile) const { return slot[tile] != NotFree; }
+	uint32_t size() const { return uint32_t(tiles.size()); }
+	bool empty() const { return tiles.empty(); }
+
+	//mark every tile of the rectangle [x0,x1) x [y0,y1) as free:
+	void insert_rect(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1);
+
+	//uniformly random free tile (index must not be empty):
+	uint32_t pick(Rng &rng) const { return tiles[rng.below(size())]; }
+
+	//internals:
+	static constexpr uint32_t NotFree = ~uint32_t(0);
+	std::pmr::vector< uint32_t > tiles; //the free tiles, in no particular order
+	std::pmr::vector< uint32_t > slot; //tile -> position in 'tiles' (or NotFree)
+};
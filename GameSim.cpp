@@ -0,0 +1,450 @@
+#include "GameSim.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <array>
+
+GameSim::GameSim(uint16_t cols_, uint16_t rows_, uint16_t start_size, std::pmr::memory_resource *memory)
+	: cols(cols_), rows(rows_), kinds(memory), owners(memory), births(memory), free_tiles(cols_, rows_, memory),
+	  players(memory), trails(memory), territory_bounds(memory), bounds_stale(memory), changed_tiles(memory), tile_changed(memory), fill_grid(memory), fill_stack(memory), fill_bits(memory) {
+	assert(start_size >= MinSize && cols >= start_size && rows >= start_size && "board must fit the starting area");
+	assert(cols <= MaxSize && rows <= MaxSize);
+	win_threshold = uint32_t(rows) * uint32_t(cols) / 2;
+
+	uint32_t count = uint32_t(cols) * uint32_t(rows);
+	kinds.assign(count, Tile::Empty);
+	owners.assign(count, NoOwner);
+	births.assign(count, 0);
+	tile_changed.assign(count, 0);
+	players.reserve(MaxPlayers);
+	territory_bounds.reserve(MaxPlayers);
+	bounds_stale.reserve(MaxPlayers);
+	kernels = &Kernels::get();
+	fill_grid.assign((uint32_t(cols) + 2) * (uint32_t(rows) + 2), 0);
+	fill_stack.reserve(FillStackReserve * (uint32_t(cols) + uint32_t(rows) + 2));
+	fill_bits.assign(2 * ((uint32_t(cols) + 2 + 63) / 64) * (uint32_t(rows) + 2), 0);
+
+	// players start in the middle start_size x start_size tiles:
+	horizontal_border = (cols - start_size) / 2;
+	vertical_border = (rows - start_size) / 2;
+	free_tiles.insert_rect(horizontal_border, vertical_border, cols - horizontal_border, rows - vertical_border);
+}
+
+uint16_t GameSim::start_size_for(uint32_t players) {
+	uint16_t size = MinSize;
+	while (uint32_t(size) * size < 4 * players) size += 1;
+	return size;
+}
+
+void GameSim::set_tile(uint16_t x, uint16_t y, Tile::Kind kind, uint8_t owner) {
+	uint32_t index = this->index(x, y);
+	bool changed = (kinds[index] != kind || owners[index] != owner);
+	if (changed) tiles_hash ^= tile_key(index, kinds[index], owners[index]) ^ tile_key(index, kind, owner);
+	// every ownership change comes through here, so areas are kept up to date as tiles change hands:
+	if (kinds[index] == Tile::Territory && owners[index] < players.size()) players[owners[index]].area -= 1;
+	if (kind == Tile::Territory && owner < players.size()) players[owner].area += 1;
+	// (losing a tile on the edge of the owner's box may let the box shrink)
+	if (kinds[index] == Tile::Territory && owners[index] < territory_bounds.size() && changed) {
+		Box const &box = territory_bounds[owners[index]];
+		if (x == box.x0 || y == box.y0 || x + 1 == box.x1 || y + 1 == box.y1) bounds_stale[owners[index]] = 1;
+	}
+	kinds[index] = kind;
+	owners[index] = owner;
+	births[index] = (owner < players.size() ? players[owner].visits : 0);
+	if (kind == Tile::Territory && owner < territory_bounds.size()) territory_bounds[owner].grow(x, y);
+
+	if (kind == Tile::Empty && in_bounds(x, y)) free_tiles.insert(index);
+	else free_tiles.erase(index);
+
+	if (changed && !tile_changed[index]) {
+		tile_changed[index] = 1;
+		changed_tiles.emplace_back(index);
+	}
+}
+
+void GameSim::set_borders(uint16_t horizontal, uint16_t vertical) {
+	uint16_t old_h = horizontal_border;
+	uint16_t old_v = vertical_border;
+	horizontal_border = std::min(horizontal, old_h);
+	vertical_border = std::min(vertical, old_v);
+
+	// empty tiles uncovered by the walls moving out become free:
+	auto open = [this](uint32_t x0, uint32_t y, uint32_t x1) {
+		for (uint32_t x = x0; x < x1; ++x) {
+			if (kinds[y * cols + x] == Tile::Empty) free_tiles.insert(y * cols + x);
+		}
+	};
+	for (uint32_t y = vertical_border; y < uint32_t(rows - vertical_border); ++y) {
+		if (y < old_v || y >= uint32_t(rows - old_v)) { // whole row is new
+			open(horizontal_border, y, cols - horizontal_border);
+		} else { // just the ends of the row are new
+			open(horizontal_border, y, old_h);
+			open(cols - old_h, y, cols - horizontal_border);
+		}
+	}
+}
+
+bool GameSim::place_powerup(Rng &rng) {
+	if (free_tiles.empty()) return false;
+
+	uint32_t index = free_tiles.pick(rng);
+	powerup.x = uint16_t(index % cols);
+	powerup.y = uint16_t(index / cols);
+	powerup.type = PowerupType(rng.below(2));
+
+	// a new powerup replaces any powerup players are holding:
+	for (auto &player : players) {
+		player.powerup = no_powerup;
+	}
+	powerup_changed = true;
+	return true;
+}
+
+void GameSim::add_player(uint8_t id, Rng &rng) {
+	assert(id < MaxPlayers);
+	if (players.size() <= id) players.resize(id + 1);
+	if (trails.size() < (id + 1) * TrailCapacity) trails.resize((id + 1) * TrailCapacity);
+	if (territory_bounds.size() <= id) territory_bounds.resize(id + 1);
+	if (bounds_stale.size() <= id) bounds_stale.resize(id + 1, 0);
+
+	Pos pos;
+	bool taken;
+	do {
+		pos.x = uint16_t(rng.below(cols - horizontal_border * 2) + horizontal_border);
+		pos.y = uint16_t(rng.below(rows - vertical_border * 2) + vertical_border);
+		taken = false;
+		for (auto const &other : players) {
+			if (other.active && other.pos == pos) taken = true;
+		}
+	} while (taken);
+
+	Player &player = players[id];
+	uint32_t area = player.area; // (territory left behind by an earlier player with this id is still theirs)
+	player = Player();
+	player.area = area;
+	player.active = true;
+	player.pos = pos;
+	player.prev_pos[0] = pos;
+	player.prev_pos[1] = pos;
+
+	set_tile(pos.x, pos.y, Tile::Trail, id);
+	push_trail(id, index(pos.x, pos.y));
+}
+
+void GameSim::remove_player(uint8_t id) {
+	if (id >= players.size() || !players[id].active) return;
+	players[id].active = false;
+	clear_trail(id);
+}
+
+void GameSim::set_input(uint8_t id, Dir dir) {
+	if (id >= players.size() || !players[id].active) return;
+	players[id].dir = (dir <= none ? dir : none);
+}
+
+GameSim::Pos GameSim::predict_move(Pos pos, Dir dir) const {
+	Player p;
+	p.pos = pos;
+	p.dir = (dir <= none ? dir : none);
+	// speed powerup moves a second tile (ll/rr/uu/dd):
+	if (move_once(p) && p.dir > down) move_once(p);
+	return p.pos;
+}
+
+void GameSim::step() {
+	if (game_over) return;
+	tick += 1;
+
+	for (uint8_t id = 0; id < players.size(); ++id) {
+		Player &player = players[id];
+		if (!player.active) continue;
+
+		bool moved = move_once(player);
+		visit(id, moved);
+		if (game_over) return;
+
+		// speed powerup moves a second tile (ll/rr/uu/dd):
+		if (moved && player.dir != none && player.dir > down) {
+			if (move_once(player)) {
+				visit(id, true);
+				if (game_over) return;
+			}
+		}
+	}
+}
+
+uint64_t GameSim::state_hash() const {
+	//FNV-1a over the state, one value at a time:
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	auto mix = [&hash](uint64_t value) {
+		for (uint32_t i = 0; i < 8; ++i) {
+			hash ^= (value >> (8 * i)) & 0xff;
+			hash *= 0x100000001b3ULL;
+		}
+	};
+	mix(tick);
+	mix(horizontal_border); mix(vertical_border);
+	mix(game_over); mix(winner); mix(winner_area);
+	for (uint32_t index = 0; index < kinds.size(); ++index) {
+		mix(uint64_t(kinds[index]) | (uint64_t(owners[index]) << 8) | (uint64_t(trail_age(index)) << 16));
+	}
+	mix(uint64_t(powerup.type) | (uint64_t(powerup.x) << 8) | (uint64_t(powerup.y) << 24));
+	for (auto const &p : players) {
+		mix(uint64_t(p.active) | (uint64_t(p.dir) << 8) | (uint64_t(p.powerup) << 16));
+		mix(uint64_t(p.pos.x) | (uint64_t(p.pos.y) << 16));
+		mix(uint64_t(p.prev_pos[0].x) | (uint64_t(p.prev_pos[0].y) << 16)
+		  | (uint64_t(p.prev_pos[1].x) << 32) | (uint64_t(p.prev_pos[1].y) << 48));
+		mix(p.area);
+		mix(p.visits);
+	}
+	return hash;
+}
+
+//splitmix64 finalizer (see: https://prng.di.unimi.it/splitmix64.c):
+static uint64_t mix64(uint64_t z) {
+	z += 0x9e3779b97f4a7c15ULL;
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+uint64_t GameSim::tile_key(uint32_t index, Tile::Kind kind, uint8_t owner) {
+	if (kind == Tile::Empty) return 0;
+	return mix64((uint64_t(index) << 16) | (uint64_t(kind) << 8) | owner);
+}
+
+uint64_t GameSim::player_key(uint8_t id, Pos const &pos) {
+	return mix64((uint64_t(1) << 63) | (uint64_t(id) << 32) | (uint64_t(pos.x) << 16) | pos.y);
+}
+
+uint64_t GameSim::board_hash() const {
+	uint64_t hash = tiles_hash;
+	for (uint32_t id = 0; id < players.size(); ++id) {
+		if (players[id].active) hash ^= player_key(uint8_t(id), players[id].pos);
+	}
+	return hash;
+}
+
+void GameSim::clear_changes() {
+	for (uint32_t index : changed_tiles) {
+		tile_changed[index] = 0;
+	}
+	changed_tiles.clear();
+	powerup_changed = false;
+}
+
+bool GameSim::move_once(Player &p) const {
+	if (p.dir == none) return false;
+
+	Pos old = p.pos;
+	if (p.dir % 4 == left && p.pos.x > horizontal_border) {
+		p.pos.x--;
+	}
+	else if (p.dir % 4 == right && p.pos.x < cols - 1 - horizontal_border) {
+		p.pos.x++;
+	}
+	else if (p.dir % 4 == up && p.pos.y < rows - 1 - vertical_border) {
+		p.pos.y++;
+	}
+	else if (p.dir % 4 == down && p.pos.y > vertical_border) {
+		p.pos.y--;
+	}
+	if (p.pos == old) return false;
+
+	// position changed, shift it into prev_pos
+	p.prev_pos[1] = p.prev_pos[0];
+	p.prev_pos[0] = old;
+	return true;
+}
+
+void GameSim::visit(uint8_t id, bool moving) {
+	Player &p = players[id];
+	uint16_t x = p.pos.x;
+	uint16_t y = p.pos.y;
+
+	// update and trim player's trails
+	p.visits += 1;
+	uint32_t max_len = TRAIL_MAX_LEN + (p.powerup == trail ? TRAIL_POWERUP_LEN : 0);
+	expire_trail(id, max_len);
+
+	// player gets powerup
+	if (powerup.type != no_powerup && powerup.x == x && powerup.y == y) {
+		p.powerup = powerup.type;
+		powerup.type = no_powerup;
+		powerup_changed = true;
+	}
+
+	Tile tile = at(x, y);
+	// player enters their own territory
+	if (tile.kind == Tile::Territory && tile.owner == id) {
+		// player's trail becomes territory (if there was no trail, nothing new can be enclosed)
+		if (replace_trail(id, Tile::Territory, id) > 0) capture(id);
+	}
+	// player hits their own trail
+	else if (tile.kind == Tile::Trail && tile.owner == id) {
+		if (moving) {
+			// the loop is the trail from here to the previous tile:
+			std::array< uint32_t, TrailCapacity > loop;
+			uint32_t length = trail_loop(id, index(x, y), loop.data());
+			if (length > 0) {
+				// clear player's trail and add loop to territory
+				clear_trail(id);
+				std::sort(loop.begin(), loop.begin() + length);
+				for (uint32_t i = 0; i < length; ++i) {
+					set_tile(uint16_t(loop[i] % cols), uint16_t(loop[i] / cols), Tile::Territory, id);
+				}
+				capture(id);
+				return;
+			}
+			// (no loop after all)
+		}
+		// update trail age
+		births[index(x, y)] = p.visits;
+		push_trail(id, index(x, y));
+	}
+	// player hits other player's trail or territory
+	else if (tile.kind != Tile::Empty) {
+		// hit other player's territory:
+		if (tile.kind == Tile::Territory) {
+			clear_trail(id);
+		}
+		// hit other player's trail:
+		else {
+			clear_trail(tile.owner);
+			// overwrite with our trail
+			set_tile(x, y, Tile::Trail, id);
+			push_trail(id, index(x, y));
+		}
+	}
+	else {
+		// update player's trail
+		set_tile(x, y, Tile::Trail, id);
+		push_trail(id, index(x, y));
+	}
+}
+
+void GameSim::clear_trail(uint8_t id) {
+	replace_trail(id, Tile::Empty, NoOwner);
+}
+
+void GameSim::push_trail(uint8_t id, uint32_t index) {
+	Player &p = players[id];
+	assert(p.trail_length < TrailCapacity);
+	trails[id * TrailCapacity + (p.trail_head + p.trail_length) % TrailCapacity] = TrailEntry{index, births[index]};
+	p.trail_length += 1;
+}
+
+void GameSim::expire_trail(uint8_t id, uint32_t max_len) {
+	Player &p = players[id];
+	TrailEntry const *ring = &trails[id * TrailCapacity];
+	std::array< uint32_t, TrailCapacity > expired;
+	uint32_t count = 0;
+	// entries are in birth order, so the expired ones are all at the front:
+	while (p.trail_length > 0 && p.visits - ring[p.trail_head].birth >= max_len) {
+		TrailEntry const &entry = ring[p.trail_head];
+		if (kinds[entry.index] == Tile::Trail && owners[entry.index] == id && births[entry.index] == entry.birth) {
+			expired[count++] = entry.index;
+		}
+		p.trail_head = (p.trail_head + 1) % TrailCapacity;
+		p.trail_length -= 1;
+	}
+	// (cleared in board order, as the whole-board sweep did, so the free tile index -- and thus powerup placement -- is unchanged)
+	std::sort(expired.begin(), expired.begin() + count);
+	for (uint32_t i = 0; i < count; ++i) {
+		set_tile(uint16_t(expired[i] % cols), uint16_t(expired[i] / cols), Tile::Empty, NoOwner);
+	}
+}
+
+uint32_t GameSim::live_trail(uint8_t id, uint32_t *indices) const {
+	Player const &p = players[id];
+	TrailEntry const *ring = &trails[id * TrailCapacity];
+	uint32_t count = 0;
+	for (uint32_t i = 0; i < p.trail_length; ++i) {
+		TrailEntry const &entry = ring[(p.trail_head + i) % TrailCapacity];
+		if (kinds[entry.index] == Tile::Trail && owners[entry.index] == id && births[entry.index] == entry.birth) {
+			indices[count++] = entry.index;
+		}
+	}
+	std::sort(indices, indices + count);
+	return count;
+}
+
+uint32_t GameSim::trail_loop(uint8_t id, uint32_t start, uint32_t *loop) const {
+	Player const &p = players[id];
+	TrailRing ring{&trails[id * TrailCapacity], TrailCapacity - 1, p.trail_head, p.trail_length};
+	return trail_loop(id, ring, index(p.prev_pos[0].x, p.prev_pos[0].y), start, loop);
+}
+
+uint32_t GameSim::trail_loop(uint8_t id, TrailRing const &ring, uint32_t from, uint32_t start, uint32_t *loop) const {
+	uint32_t count = 0;
+	// walk back from the newest tile until reaching 'start', as long as each tile is next to the one after it:
+	for (uint32_t i = ring.length; i > 0; --i) {
+		TrailEntry const &entry = ring.entries[(ring.head + i - 1) & ring.mask];
+		if (kinds[entry.index] != Tile::Trail || owners[entry.index] != id || births[entry.index] != entry.birth) continue;
+		if (count == 0 && entry.index != from) return 0; // (the previous tile isn't trail any more)
+		if (count > 0) {
+			uint32_t a = loop[count - 1], b = entry.index;
+			bool adjacent = (a / cols == b / cols ? (a == b + 1 || b == a + 1) : (a == b + cols || b == a + cols));
+			if (!adjacent) return 0; // (trail was broken by another player's capture)
+		}
+		loop[count++] = entry.index;
+		if (entry.index == start) return count;
+	}
+	return 0;
+}
+
+uint32_t GameSim::replace_trail(uint8_t id, Tile::Kind kind, uint8_t owner) {
+	std::array< uint32_t, TrailCapacity > trail;
+	uint32_t length = live_trail(id, trail.data());
+	players[id].trail_head = 0;
+	players[id].trail_length = 0;
+	for (uint32_t i = 0; i < length; ++i) {
+		set_tile(uint16_t(trail[i] % cols), uint16_t(trail[i] / cols), kind, owner);
+	}
+	return length;
+}
+
+GameSim::Box const &GameSim::territory_box(uint8_t id) {
+	Box &box = territory_bounds[id];
+	if (!bounds_stale[id]) return box;
+	bounds_stale[id] = 0;
+
+	// the territory is all still inside the old box, so move each side in until it reaches some:
+	auto mine = [this, id](uint16_t x, uint16_t y) {
+		uint32_t i = index(x, y);
+		return kinds[i] == Tile::Territory && owners[i] == id;
+	};
+	auto row_has = [&](uint16_t y) {
+		for (uint16_t x = box.x0; x < box.x1; ++x) if (mine(x, y)) return true;
+		return false;
+	};
+	auto column_has = [&](uint16_t x) {
+		for (uint16_t y = box.y0; y < box.y1; ++y) if (mine(x, y)) return true;
+		return false;
+	};
+	while (box.y0 < box.y1 && !row_has(box.y0)) box.y0++;
+	while (box.y0 < box.y1 && !row_has(box.y1 - 1)) box.y1--;
+	if (box.empty()) {
+		box = Box();
+		return box;
+	}
+	while (!column_has(box.x0)) box.x0++;
+	while (!column_has(box.x1 - 1)) box.x1--;
+	return box;
+}
+
+void GameSim::capture(uint8_t id) {
+	// only the part of the board this player's territory spans can be enclosed, so the fill stays there:
+	// (capture() always follows claiming some tiles, so the box isn't empty)
+	Box const &box = territory_box(id);
+	if (uint32_t(box.x1 - box.x0) * uint32_t(box.y1 - box.y0) >= BitsFillMinArea) kernels->fill_interior_bits(*this, id, box);
+	else kernels->fill_interior(*this, id, box);
+
+	// check if player has won (only captures add territory, so this is the only place it's needed)
+	uint32_t territory_size = players[id].area;
+	if (territory_size > win_threshold) {
+		game_over = true;
+		winner = id;
+		winner_area = territory_size;
+	}
+}
@@ -0,0 +1,224 @@
+#pragma once
+
+/*
+ * GameSim holds the rules of the game -- the board, players' trails,
+ * capturing territory, powerups and winning -- with no dependencies on
+ * graphics, sound, or networking, so it can be built into both the
+ * server and the client.
+ *
+ * The server owns the authoritative GameSim for each game and calls
+ * step() once per tick; changes to the board are collected in
+ * 'changed_tiles' so they can be sent to clients, which apply them to
+ * their own copy with set_tile().
+ *
+ * Coordinates: x is the column (0 = left), y is the row (0 = bottom).
+ *
+ * Everything the sim allocates -- the board, players, change lists and
+ * the flood fills' scratch space -- comes from 'memory' (the server
+ * passes each game's arena), sized up front in the constructor. The one
+ * exception is fill_stack: if a fill ever needs more than its reserve, it
+ * grows, and in a monotonic arena the outgrown buffer stays allocated
+ * (unused) until the game ends.
+ */
+
+#include "Rng.hpp"
+#include "FreeTileIndex.hpp"
+
+#include <algorithm>
+#include <vector>
+#include <memory_resource>
+#include <cstdint>
+
+struct GameSim {
+	//players start in a start_size x start_size area in the middle of the board (the rest is walled off at first):
+	GameSim(uint16_t cols = DefaultCols, uint16_t rows = DefaultRows, uint16_t start_size = MinSize,
+		std::pmr::memory_resource *memory = std::pmr::get_default_resource());
+
+	//----- constants ------
+	static constexpr uint16_t DefaultCols = 40;
+	static constexpr uint16_t DefaultRows = 20;
+	static constexpr uint16_t MinSize = 10; // (the smallest starting area is 10x10)
+	static constexpr uint16_t MaxSize = 4096;
+	static constexpr uint32_t MaxPlayers = 255; // (ids 0 .. 254; 0xff is NoOwner)
+	static constexpr uint8_t TRAIL_MAX_LEN = 50;
+	static constexpr uint8_t TRAIL_POWERUP_LEN = 20;
+	static constexpr uint8_t NoOwner = 0xff;
+	//bumped whenever a change makes the same inputs play out differently (so old recordings can be told apart):
+	static constexpr uint8_t Version = 4;
+
+	//starting area size that leaves a few tiles per player:
+	static uint16_t start_size_for(uint32_t players);
+
+	enum PowerupType : uint8_t { speed, trail, no_powerup };
+	// ll, rr, uu, dd are for player with speed powerup
+	enum Dir : uint8_t { left, right, up, down, ll, rr, uu, dd, none };
+
+	uint16_t cols, rows;
+	uint32_t win_threshold; // territory needed to win (more than half the board)
+
+	//----- board -----
+	//stored as separate planes, one entry per tile, row-major (index = y * cols + x),
+	// so whole-board scans stream through a byte or two per tile:
+	struct Tile {
+		enum Kind : uint8_t { Empty, Trail, Territory };
+		Kind kind = Empty;
+		uint8_t owner = NoOwner;
+	};
+	std::pmr::vector< Tile::Kind > kinds;
+	std::pmr::vector< uint8_t > owners;
+	std::pmr::vector< uint32_t > births; // for trail tiles: the owner's 'visits' when the tile was laid
+	uint16_t horizontal_border, vertical_border; // size of "walls" (L/R and T/B)
+
+	uint32_t index(uint16_t x, uint16_t y) const { return uint32_t(y) * cols + x; }
+	Tile at(uint16_t x, uint16_t y) const { uint32_t i = index(x, y); return Tile{kinds[i], owners[i]}; }
+	//visits by the owner since a trail tile was laid (0 for other tiles):
+	uint32_t trail_age(uint32_t index) const {
+		return (kinds[index] == Tile::Trail && owners[index] < players.size() ? players[owners[index]].visits - births[index] : 0);
+	}
+	bool in_bounds(uint16_t x, uint16_t y) const {
+		return x >= horizontal_border && x < cols - horizontal_border
+		    && y >= vertical_border && y < rows - vertical_border;
+	}
+	//all changes of tile ownership go through here (so free_tiles and changed_tiles stay up to date):
+	void set_tile(uint16_t x, uint16_t y, Tile::Kind kind, uint8_t owner);
+	//move the walls out (only ever shrinks them):
+	void set_borders(uint16_t horizontal, uint16_t vertical);
+
+	//empty tiles inside the walls (where powerups may be placed):
+	FreeTileIndex free_tiles;
+
+	//----- powerup -----
+	struct Powerup {
+		PowerupType type = no_powerup;
+		uint16_t x = 0, y = 0;
+	} powerup;
+	//put a random powerup on a random free tile (returns false if there was nowhere to put it):
+	bool place_powerup(Rng &rng);
+
+	//a rectangle of tiles, [x0,x1) x [y0,y1):
+	struct Box {
+		uint16_t x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+		bool empty() const { return x0 >= x1 || y0 >= y1; }
+		void grow(uint16_t x, uint16_t y) { // (make the box cover tile x,y)
+			if (empty()) { x0 = x; y0 = y; x1 = x + 1; y1 = y + 1; return; }
+			x0 = std::min(x0, x); x1 = std::max< uint16_t >(x1, x + 1);
+			y0 = std::min(y0, y); y1 = std::max< uint16_t >(y1, y + 1);
+		}
+	};
+
+	//----- players -----
+	struct Pos {
+		uint16_t x = 0, y = 0;
+		bool operator==(Pos const &o) const { return x == o.x && y == o.y; }
+		bool operator!=(Pos const &o) const { return !(*this == o); }
+	};
+	struct Player {
+		bool active = false;
+		Pos pos;
+		Pos prev_pos[2]; // previous 2 positions (for calculating loops)
+		// prev_pos[0] = position 1 new position ago
+		// prev_pos[1] = position 2 new positions ago
+		Dir dir = none; // latest input
+		PowerupType powerup = no_powerup;
+		uint32_t area = 0; // territory tiles owned (kept up to date by set_tile)
+		uint32_t visits = 0; // times the rules have been applied for this player (trail tiles age by one per visit)
+		uint32_t trail_head = 0, trail_length = 0; // this player's part of 'trails'
+	};
+	std::pmr::vector< Player > players; // indexed by player id (room for MaxPlayers is reserved up front)
+
+	//each player's trail, oldest first, so trail upkeep never has to look at the rest of the board:
+	//(an entry goes stale if its tile is later re-stamped or taken over; entries are checked against the board when used)
+	struct TrailEntry {
+		uint32_t index; // y * cols + x
+		uint32_t birth; // births[index] when the entry was added
+	};
+	//(the rules add at most one entry per visit, and entries expire after at most TRAIL_MAX_LEN + TRAIL_POWERUP_LEN visits):
+	static constexpr uint32_t TrailCapacity = 128;
+	static_assert(TRAIL_MAX_LEN + TRAIL_POWERUP_LEN + 1 <= TrailCapacity, "trail ring holds a whole trail");
+	static_assert((TrailCapacity & (TrailCapacity - 1)) == 0, "trail rings wrap with a mask");
+	//'length' entries of a ring of trail entries, oldest at 'head' (the ring's size is a power of two, 'mask' is one less):
+	struct TrailRing {
+		TrailEntry const *entries;
+		uint32_t mask, head, length;
+	};
+	std::pmr::vector< TrailEntry > trails; // player 'id's ring is trails[id * TrailCapacity ...]
+
+	//a box around each player's territory, kept by set_tile: it grows as tiles are claimed, and when a tile on
+	// its edge is lost it is marked stale, to be shrunk to fit the next time territory_box() is asked for it
+	//(anything a loop can enclose is inside its owner's box, so captures only search there)
+	std::pmr::vector< Box > territory_bounds; // indexed by player id
+	std::pmr::vector< uint8_t > bounds_stale; // indexed by player id
+	Box const &territory_box(uint8_t id); // territory_bounds[id], shrunk to fit first if it was stale
+
+	//add player 'id' (< MaxPlayers) at a random spot in the starting area not taken by another player:
+	void add_player(uint8_t id, Rng &rng);
+	//stop simulating player 'id' (their trail is cleared, their territory stays on the board):
+	void remove_player(uint8_t id);
+	void set_input(uint8_t id, Dir dir);
+	//where a player at 'pos' heading 'dir' ends up after one step, minding only the borders
+	// (same moves as step(); clients use it to predict their own player):
+	Pos predict_move(Pos pos, Dir dir) const;
+
+	//----- simulation -----
+	uint32_t tick = 0;
+	bool game_over = false;
+	uint8_t winner = NoOwner;
+	uint32_t winner_area = 0;
+
+	//move every player according to their input and apply the rules:
+	void step();
+
+	//hash of the board, powerup, players and tick (equal hashes => a re-run reproduced the game):
+	uint64_t state_hash() const;
+
+	//----- desync detection -----
+	//Zobrist hash of tile ownership and trails (kept up to date by set_tile, so O(1) per change)
+	// combined with active players' positions -- cheap enough to compare every few ticks:
+	uint64_t board_hash() const;
+	uint64_t tiles_hash = 0; // XOR of tile_key() over non-empty tiles
+	//(keys come from a 64-bit mixer rather than a table, so any board size works):
+	static uint64_t tile_key(uint32_t index, Tile::Kind kind, uint8_t owner);
+	static uint64_t player_key(uint8_t id, Pos const &pos);
+
+	//----- changes since last clear_changes() -----
+	std::pmr::vector< uint32_t > changed_tiles; // (y * cols + x), each listed once
+	std::pmr::vector< uint8_t > tile_changed; // per-tile flag for changed_tiles
+	bool powerup_changed = false;
+	void clear_changes();
+
+	//----- bulk tile loops -----
+	//(see GridKernels.cpp)
+	struct Kernels {
+		//claim the regions inside 'box' enclosed by id's territory (the tiles just outside the box count as outside,
+		// so regions reaching its edge are never claimed), returns the number of tiles claimed:
+		//(two versions that always agree: a scanline flood fill, quickest on small boxes, and a bit-parallel
+		// fill on bitboards of the box, for big ones -- capture() picks by size)
+		uint32_t (*fill_interior)(GameSim &sim, uint8_t id, Box const &box);
+		uint32_t (*fill_interior_bits)(GameSim &sim, uint8_t id, Box const &box);
+
+		static Kernels const &get();
+		static Kernels const &scalar(); // (get() without any SIMD paths, to check them against)
+	};
+	Kernels const *kernels; // (set by the constructor)
+	//scratch space for fill_interior, allocated with the board so captures don't allocate:
+	std::pmr::vector< uint8_t > fill_grid; // room for the whole board plus a 1 tile border all round
+	std::pmr::vector< uint32_t > fill_stack; // cells of fill_grid waiting to be filled (grows -- and stays grown -- if a fill ever needs more; in an arena the old buffer is left behind)
+	static constexpr uint32_t FillStackReserve = 4; // (fill_stack starts with room for this many seeds per row and column)
+	std::pmr::vector< uint64_t > fill_bits; // fill_interior_bits' two bitboards of the board plus border, rows padded to whole words
+	static constexpr uint32_t BitsFillMinArea = 64 * 64; // (boxes at least this big use fill_interior_bits)
+
+	//----- rule helpers -----
+	bool move_once(Player &p) const; // returns true if the player moved
+	void visit(uint8_t id, bool moving); // apply the rules for player 'id' arriving on (or staying on) a tile
+	void clear_trail(uint8_t id);
+	void push_trail(uint8_t id, uint32_t index); // (after laying or re-stamping a trail tile)
+	void expire_trail(uint8_t id, uint32_t max_len); // clear trail tiles 'max_len' or more visits old
+	uint32_t live_trail(uint8_t id, uint32_t *indices) const; // id's trail tiles in board order (up to TrailCapacity), returns count
+	//the loop closed by id stepping back onto their trail at 'start': the trail from 'start' to the previous tile
+	// (in trail order, up to TrailCapacity tiles), or 0 if it isn't connected:
+	uint32_t trail_loop(uint8_t id, uint32_t start, uint32_t *loop) const;
+	//(the same, for any ring of id's trail that ends at 'from' -- sim-bench times it on trails longer than the rules allow)
+	uint32_t trail_loop(uint8_t id, TrailRing const &ring, uint32_t from, uint32_t start, uint32_t *loop) const;
+	uint32_t replace_trail(uint8_t id, Tile::Kind kind, uint8_t owner); // set every tile of id's trail, returns how many there were
+	void capture(uint8_t id); // fill enclosed areas (within territory_bounds[id]), check for a win
+};
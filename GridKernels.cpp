@@ -0,0 +1,299 @@
+//GridKernels are GameSim's bulk tile loops (see GameSim::Kernels).
+//
+//They work on a box of the board at a time (copied into scratch space the sim owns), so the
+// board's size only matters at the box's edges and one version serves every board.
+//
+//fill_interior_bits has AVX2 paths, compiled when the build targets AVX2 (jam -sAVX2=1; see the Jamfile);
+// Kernels::scalar() is the same table with them turned off, so sim-bench --check can compare the two.
+
+#include "GameSim.hpp"
+
+#include <algorithm>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace {
+
+typedef GameSim::Tile Tile;
+
+//----- bitboard helpers (for fill_interior_bits) -----
+
+inline uint32_t popcount(uint64_t bits) {
+#if defined(_MSC_VER)
+	return uint32_t(__popcnt64(bits));
+#else
+	return uint32_t(__builtin_popcountll(bits));
+#endif
+}
+
+inline uint32_t lowest_bit(uint64_t bits) { // (bits != 0)
+#if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanForward64(&index, bits);
+	return uint32_t(index);
+#else
+	return uint32_t(__builtin_ctzll(bits));
+#endif
+}
+
+//spread the bits of 'seen' through the runs of 'open' they are in (seen must be a subset of open):
+// towards the high bits, adding a seed to its run carries all the way to the run's top:
+inline uint64_t spread_up(uint64_t seen, uint64_t open) {
+	return seen | (((seen + open) ^ open) & open);
+}
+// towards the low bits, in doubling steps (Kogge-Stone):
+inline uint64_t spread_down(uint64_t seen, uint64_t open) {
+	seen |= open & (seen >> 1); open &= open >> 1;
+	seen |= open & (seen >> 2); open &= open >> 2;
+	seen |= open & (seen >> 4); open &= open >> 4;
+	seen |= open & (seen >> 8); open &= open >> 8;
+	seen |= open & (seen >> 16); open &= open >> 16;
+	seen |= open & (seen >> 32);
+	return seen;
+}
+
+#if defined(__AVX2__)
+//the same, on four words at once:
+inline __m256i spread_up(__m256i seen, __m256i open) {
+	return _mm256_or_si256(seen, _mm256_and_si256(_mm256_xor_si256(_mm256_add_epi64(seen, open), open), open));
+}
+inline __m256i spread_down(__m256i seen, __m256i open) {
+	seen = _mm256_or_si256(seen, _mm256_and_si256(open, _mm256_srli_epi64(seen, 1))); open = _mm256_and_si256(open, _mm256_srli_epi64(open, 1));
+	seen = _mm256_or_si256(seen, _mm256_and_si256(open, _mm256_srli_epi64(seen, 2))); open = _mm256_and_si256(open, _mm256_srli_epi64(open, 2));
+	seen = _mm256_or_si256(seen, _mm256_and_si256(open, _mm256_srli_epi64(seen, 4))); open = _mm256_and_si256(open, _mm256_srli_epi64(open, 4));
+	seen = _mm256_or_si256(seen, _mm256_and_si256(open, _mm256_srli_epi64(seen, 8))); open = _mm256_and_si256(open, _mm256_srli_epi64(open, 8));
+	seen = _mm256_or_si256(seen, _mm256_and_si256(open, _mm256_srli_epi64(seen, 16))); open = _mm256_and_si256(open, _mm256_srli_epi64(open, 16));
+	seen = _mm256_or_si256(seen, _mm256_and_si256(open, _mm256_srli_epi64(seen, 32)));
+	return seen;
+}
+#endif
+
+//bit x of the result is set if tile x of the 'count' (<= 64) tiles starting at kinds/owners is id's territory:
+template< bool Simd >
+inline uint64_t territory_bits(Tile::Kind const *kinds, uint8_t const *owners, uint8_t id, uint32_t count) {
+	uint64_t bits = 0;
+	uint32_t x = 0;
+#if defined(__AVX2__)
+	__m256i const territory = _mm256_set1_epi8(char(Tile::Territory));
+	__m256i const owner = _mm256_set1_epi8(char(id));
+	for (; Simd && x + 32 <= count; x += 32) {
+		__m256i k = _mm256_loadu_si256(reinterpret_cast< __m256i const * >(kinds + x));
+		__m256i o = _mm256_loadu_si256(reinterpret_cast< __m256i const * >(owners + x));
+		__m256i mine = _mm256_and_si256(_mm256_cmpeq_epi8(k, territory), _mm256_cmpeq_epi8(o, owner));
+		bits |= uint64_t(uint32_t(_mm256_movemask_epi8(mine))) << x;
+	}
+#endif
+	for (; x < count; ++x) {
+		bits |= uint64_t((kinds[x] == Tile::Territory) & (owners[x] == id)) << x;
+	}
+	return bits;
+}
+
+//grow row 'out' by the bits of row 'from' (its neighbor) and then along its runs of 'open', returns true if it changed:
+template< bool Simd >
+inline bool dilate_row(uint64_t const *from, uint64_t const *open, uint64_t *out, uint32_t words) {
+	uint64_t changed = 0;
+	uint32_t w = 0;
+#if defined(__AVX2__)
+	for (; Simd && w + 4 <= words; w += 4) {
+		__m256i o = _mm256_loadu_si256(reinterpret_cast< __m256i const * >(open + w));
+		__m256i before = _mm256_loadu_si256(reinterpret_cast< __m256i const * >(out + w));
+		__m256i seen = _mm256_or_si256(before, _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast< __m256i const * >(from + w)), o));
+		seen = spread_down(spread_up(seen, o), o);
+		_mm256_storeu_si256(reinterpret_cast< __m256i * >(out + w), seen);
+		changed |= uint64_t(~_mm256_movemask_epi8(_mm256_cmpeq_epi64(seen, before)) & 0xffffffff);
+	}
+#endif
+	for (; w < words; ++w) {
+		uint64_t seen = out[w] | (from[w] & open[w]);
+		seen = spread_down(spread_up(seen, open[w]), open[w]);
+		changed |= seen ^ out[w];
+		out[w] = seen;
+	}
+	//runs that cross from one word to the next:
+	for (w = 1; w < words; ++w) {
+		if ((out[w - 1] >> 63) & ~out[w] & open[w] & 1) {
+			out[w] = spread_up(out[w] | 1, open[w]);
+			changed = 1;
+		}
+	}
+	for (w = words - 1; w > 0; --w) {
+		if ((out[w] & 1) && ((~out[w - 1] & open[w - 1]) >> 63)) {
+			out[w - 1] = spread_down(out[w - 1] | (uint64_t(1) << 63), open[w - 1]);
+			changed = 1;
+		}
+	}
+	return changed != 0;
+}
+
+struct GridKernels {
+	//fill_interior's grid (GameSim::fill_grid) is the box plus a 1 tile border on all sides, row-major:
+	enum Cell : uint8_t {
+		Outside, // not (yet) known to be outside the player's territory
+		Queued, // Outside, and on fill_stack
+		Border, // the player's territory
+		Fill, // reached from the edge of the box, so not enclosed
+	};
+
+	static uint32_t fill_interior(GameSim &sim, uint8_t id, GameSim::Box const &box) {
+		uint32_t const C = sim.cols;
+		uint32_t const W = box.x1 - box.x0, H = box.y1 - box.y0;
+		uint32_t const stride = W + 2;
+		uint8_t *grid = sim.fill_grid.data();
+		auto &stack = sim.fill_stack;
+
+		std::memset(grid, Outside, stride);
+		std::memset(grid + (H + 1) * stride, Outside, stride);
+		for (uint32_t y = 0; y < H; ++y) {
+			Tile::Kind const *kinds = &sim.kinds[(box.y0 + y) * C + box.x0];
+			uint8_t const *owners = &sim.owners[(box.y0 + y) * C + box.x0];
+			uint8_t *cells = &grid[(y + 1) * stride];
+			cells[0] = Outside;
+			cells[W + 1] = Outside;
+			for (uint32_t x = 0; x < W; ++x) {
+				cells[x + 1] = (kinds[x] == Tile::Territory && owners[x] == id ? Border : Outside);
+			}
+		}
+
+		// scanline fill of the outer area, starting from the border (bottom-left):
+		// each popped seed is widened to a whole span of its row, then the start of every run of
+		// unfilled cells above and below the span is pushed (cells are marked Queued so none is pushed twice)
+		stack.clear();
+		stack.emplace_back(0);
+		grid[0] = Queued;
+		while (!stack.empty()) {
+			uint32_t at = stack.back();
+			stack.pop_back();
+			if (grid[at] == Fill) continue; // (already part of another span)
+			uint32_t y = at / stride;
+			uint32_t row = y * stride;
+			uint32_t x0 = at - row, x1 = x0;
+			while (x0 > 0 && grid[row + x0 - 1] <= Queued) --x0;
+			while (x1 + 1 < stride && grid[row + x1 + 1] <= Queued) ++x1;
+			std::memset(grid + row + x0, Fill, x1 - x0 + 1);
+
+			auto seed = [&](uint32_t other) {
+				bool in_run = false;
+				for (uint32_t x = x0; x <= x1; ++x) {
+					uint8_t cell = grid[other + x];
+					if (cell == Outside && !in_run) {
+						grid[other + x] = Queued;
+						stack.emplace_back(other + x);
+					}
+					in_run = (cell <= Queued);
+				}
+			};
+			if (y > 0) seed(row - stride);
+			if (y + 1 < H + 2) seed(row + stride);
+		}
+
+		// set all non-filled/interior tiles to player's territory
+		uint32_t claimed = 0;
+		for (uint32_t y = 0; y < H; ++y) {
+			uint8_t const *cells = &grid[(y + 1) * stride + 1];
+			for (uint32_t x = 0; x < W; ++x) {
+				if (cells[x] == Outside) {
+					sim.set_tile(uint16_t(box.x0 + x), uint16_t(box.y0 + y), Tile::Territory, id);
+					claimed++;
+				}
+			}
+		}
+		return claimed;
+	}
+
+	//fill_interior_bits' bitboards (in GameSim::fill_bits) cover the same box-plus-border grid as fill_interior's,
+	// one bit per tile, each row starting on a fresh 64-bit word:
+	//  open -- tiles that aren't the player's territory (the border is all open)
+	//  out -- open tiles connected to the border, grown from the border a whole row at a time until it stops changing
+	template< bool Simd >
+	static uint32_t fill_interior_bits(GameSim &sim, uint8_t id, GameSim::Box const &box) {
+		uint32_t const C = sim.cols;
+		uint32_t const W = box.x1 - box.x0, H = box.y1 - box.y0;
+		uint32_t const bits = W + 2, words = (bits + 63) / 64, height = H + 2;
+		uint64_t *open = sim.fill_bits.data();
+		uint64_t *out = open + words * height;
+		uint64_t const full_last = (bits % 64 ? (uint64_t(1) << (bits % 64)) - 1 : ~uint64_t(0)); // (the bits of a row's last word in the grid)
+		uint64_t const right_edge = uint64_t(1) << ((bits - 1) % 64);
+
+		for (uint32_t w = 0; w < words; ++w) {
+			uint64_t all = (w + 1 < words ? ~uint64_t(0) : full_last);
+			open[w] = out[w] = all;
+			open[(height - 1) * words + w] = out[(height - 1) * words + w] = all;
+		}
+		for (uint32_t y = 0; y < H; ++y) {
+			Tile::Kind const *kinds = &sim.kinds[(box.y0 + y) * C + box.x0];
+			uint8_t const *owners = &sim.owners[(box.y0 + y) * C + box.x0];
+			uint64_t *open_row = &open[(y + 1) * words];
+			uint64_t *out_row = &out[(y + 1) * words];
+			std::memset(open_row, 0, words * sizeof(uint64_t));
+			std::memset(out_row, 0, words * sizeof(uint64_t));
+			for (uint32_t x = 0; x < W; x += 64) {
+				uint32_t count = std::min< uint32_t >(64, W - x);
+				uint64_t others = ~territory_bits< Simd >(kinds + x, owners + x, id, count);
+				if (count < 64) others &= (uint64_t(1) << count) - 1;
+				// (tile x is bit x + 1 of the row)
+				open_row[x / 64] |= others << 1;
+				if (others >> 63) open_row[x / 64 + 1] |= 1;
+			}
+			open_row[0] |= 1;
+			open_row[words - 1] |= right_edge;
+			out_row[0] = 1;
+			out_row[words - 1] |= right_edge;
+		}
+
+		// sweep down and then up the rows, spreading 'out' from each row to the next, until a round changes nothing:
+		bool changed = true;
+		while (changed) {
+			changed = false;
+			for (uint32_t y = 1; y + 1 < height; ++y) {
+				changed |= dilate_row< Simd >(&out[(y - 1) * words], &open[y * words], &out[y * words], words);
+			}
+			for (uint32_t y = height - 2; y > 0; --y) {
+				changed |= dilate_row< Simd >(&out[(y + 1) * words], &open[y * words], &out[y * words], words);
+			}
+		}
+
+		// set all open tiles that aren't out to player's territory
+		uint32_t claimed = 0;
+		for (uint32_t y = 0; y < H; ++y) {
+			uint64_t const *open_row = &open[(y + 1) * words];
+			uint64_t const *out_row = &out[(y + 1) * words];
+			for (uint32_t w = 0; w < words; ++w) {
+				uint64_t inside = open_row[w] & ~out_row[w];
+				claimed += popcount(inside);
+				while (inside) {
+					uint32_t x = w * 64 + lowest_bit(inside) - 1;
+					sim.set_tile(uint16_t(box.x0 + x), uint16_t(box.y0 + y), Tile::Territory, id);
+					inside &= inside - 1;
+				}
+			}
+		}
+		return claimed;
+	}
+};
+
+} //namespace
+
+GameSim::Kernels const &GameSim::Kernels::get() {
+	static Kernels const table = {
+		&GridKernels::fill_interior,
+		&GridKernels::fill_interior_bits< true >,
+	};
+	return table;
+}
+
+GameSim::Kernels const &GameSim::Kernels::scalar() {
+	static Kernels const table = {
+		&GridKernels::fill_interior,
+		&GridKernels::fill_interior_bits< false >,
+	};
+	return table;
+}
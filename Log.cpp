@@ -0,0 +1,224 @@
+#include "Log.hpp"
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <vector>
+#include <memory>
+#include <iostream>
+#include <cstdio>
+
+namespace Log {
+
+static_assert((RingSize & (RingSize - 1)) == 0, "RingSize must be a power of two");
+static_assert(TextSize <= 0xffff, "text offsets are 16-bit");
+
+//single-producer (the owning thread), single-consumer (the writer thread) ring of records:
+struct Ring {
+	Record records[RingSize];
+	std::atomic< uint32_t > head{0}; // next record to fill (only written by owning thread)
+	std::atomic< uint32_t > tail{0}; // next record to write out (only written by writer thread)
+	std::atomic< uint64_t > dropped{0}; // records dropped because the ring was full
+};
+
+struct Writer {
+	Writer() : start(std::chrono::steady_clock::now()), thread([this](){ run(); }) { }
+	~Writer() {
+		quit = true;
+		thread.join();
+	}
+
+	//rings of every thread that has logged (the mutex is only taken by a thread's first log call and by the writer):
+	std::mutex mutex;
+	std::vector< std::unique_ptr< Ring > > rings;
+
+	Ring *add_ring() {
+		std::lock_guard< std::mutex > lock(mutex);
+		rings.emplace_back(new Ring());
+		return rings.back().get();
+	}
+
+	std::chrono::steady_clock::time_point start;
+	std::atomic< bool > quit{false};
+	std::atomic< uint64_t > drains{0}; // completed drain() calls (flush() uses this to know output is done)
+
+	//rate limiting (only touched by the writer thread):
+	double budget = MaxLinesPerSecond; // lines that may be written right now
+	std::chrono::steady_clock::time_point budget_time = start;
+	std::atomic< uint64_t > rate_limited{0};
+	uint64_t reported_dropped = 0; // dropped records already mentioned in the output
+
+	uint64_t dropped() {
+		uint64_t total = rate_limited;
+		std::lock_guard< std::mutex > lock(mutex);
+		for (auto const &ring : rings) {
+			total += ring->dropped;
+		}
+		return total;
+	}
+
+	void format(Record const &record, std::string &line);
+	bool drain();
+	void run() {
+		while (!quit) {
+			if (!drain()) std::this_thread::sleep_for(std::chrono::milliseconds(5));
+		}
+		drain(); // write whatever is left on the way out
+	}
+
+	std::thread thread; // (last, so everything else is constructed before it starts)
+};
+
+static Writer &writer() {
+	static Writer w;
+	return w;
+}
+
+static thread_local Ring *ring = nullptr;
+
+Record *claim(Level level, char const *format) {
+	if (!ring) ring = writer().add_ring();
+	uint32_t head = ring->head.load(std::memory_order_relaxed);
+	if (head - ring->tail.load(std::memory_order_acquire) >= RingSize) {
+		ring->dropped.fetch_add(1, std::memory_order_relaxed);
+		return nullptr;
+	}
+	Record &record = ring->records[head & (RingSize - 1)];
+	record.time = std::chrono::steady_clock::now();
+	record.format = format;
+	record.level = level;
+	record.arg_count = 0;
+	record.text_used = 0;
+	return &record;
+}
+
+void publish() {
+	ring->head.store(ring->head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void Record::add_text(Arg &arg, char const *value, size_t length) {
+	uint32_t space = TextSize - text_used;
+	bool truncated = (length > space);
+	if (truncated) length = space;
+	std::memcpy(text + text_used, value, length);
+	if (truncated && length >= 3) std::memcpy(text + text_used + length - 3, "...", 3);
+	arg.type = Arg::Text;
+	arg.text.offset = text_used;
+	arg.text.length = uint16_t(length);
+	text_used += uint16_t(length);
+}
+
+void Writer::format(Record const &record, std::string &line) {
+	char number[32];
+	std::snprintf(number, sizeof(number), "[%.3f] ", std::chrono::duration< double >(record.time - start).count());
+	line = number;
+
+	uint32_t next_arg = 0;
+	for (char const *c = record.format; *c != '\0'; ++c) {
+		if (c[0] == '{' && c[1] == '}' && next_arg < record.arg_count) {
+			Record::Arg const &arg = record.args[next_arg++];
+			if (arg.type == Record::Arg::Int) {
+				line += std::to_string(arg.i);
+			} else if (arg.type == Record::Arg::Uint) {
+				line += std::to_string(arg.u);
+			} else if (arg.type == Record::Arg::Double) {
+				std::snprintf(number, sizeof(number), "%g", arg.d);
+				line += number;
+			} else if (arg.type == Record::Arg::Char) {
+				line += arg.c;
+			} else {
+				line.append(record.text + arg.text.offset, arg.text.length);
+			}
+			++c;
+		} else {
+			line += *c;
+		}
+	}
+	line += '\n';
+}
+
+//write out everything currently in the rings; returns false if there was nothing to do:
+bool Writer::drain() {
+	//refill the line budget:
+	auto now = std::chrono::steady_clock::now();
+	budget += std::chrono::duration< double >(now - budget_time).count() * MaxLinesPerSecond;
+	if (budget > MaxLinesPerSecond) budget = MaxLinesPerSecond;
+	budget_time = now;
+
+	bool did_work = false;
+	std::string line;
+	//output in order, as runs of lines headed to the same stream:
+	std::vector< std::pair< bool, std::string > > chunks; // (to stderr?, lines)
+	auto emit = [&chunks](bool to_err, std::string const &text) {
+		if (chunks.empty() || chunks.back().first != to_err) chunks.emplace_back(to_err, std::string());
+		chunks.back().second += text;
+	};
+	uint64_t dropped = 0;
+	{ //(output happens after the lock is released, so a thread's first log call never waits on I/O)
+		std::lock_guard< std::mutex > lock(mutex);
+		for (auto const &r : rings) {
+			uint32_t tail = r->tail.load(std::memory_order_relaxed);
+			uint32_t head = r->head.load(std::memory_order_acquire);
+			for (; tail != head; ++tail) {
+				did_work = true;
+				Record const &record = r->records[tail & (RingSize - 1)];
+				if (budget < 1.0) {
+					rate_limited.fetch_add(1, std::memory_order_relaxed);
+					continue;
+				}
+				budget -= 1.0;
+				format(record, line);
+				emit(record.level != Info, line);
+			}
+			r->tail.store(tail, std::memory_order_release);
+			dropped += r->dropped.load(std::memory_order_relaxed);
+		}
+	}
+
+	//mention drops once there is room to write again:
+	dropped += rate_limited.load(std::memory_order_relaxed);
+	if (dropped > reported_dropped && budget >= 1.0) {
+		emit(true, "[log] " + std::to_string(dropped - reported_dropped) + " messages dropped\n");
+		reported_dropped = dropped;
+		did_work = true;
+	}
+
+	for (auto const &chunk : chunks) {
+		if (chunk.first) {
+			std::cerr << chunk.second;
+		} else {
+			std::cout << chunk.second;
+			std::cout.flush();
+		}
+	}
+	drains.fetch_add(1, std::memory_order_release);
+	return did_work;
+}
+
+void flush() {
+	Writer &w = writer();
+	//note where every ring's head is now, then wait for the writer to get past it:
+	std::vector< std::pair< Ring *, uint32_t > > targets;
+	{
+		std::lock_guard< std::mutex > lock(w.mutex);
+		for (auto const &r : w.rings) {
+			targets.emplace_back(r.get(), r->head.load(std::memory_order_acquire));
+		}
+	}
+	for (auto const &target : targets) {
+		while (int32_t(target.first->tail.load(std::memory_order_acquire) - target.second) < 0) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+	//...and for the drain that took those records to finish writing them:
+	uint64_t drains = w.drains.load(std::memory_order_acquire);
+	while (w.drains.load(std::memory_order_acquire) < drains + 2) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+}
+
+uint64_t dropped() {
+	return writer().dropped();
+}
+
+} //namespace Log
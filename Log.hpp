@@ -0,0 +1,115 @@
+#pragma once
+
+/*
+ * Log lets the tick thread report events without ever waiting on the
+ * terminal (or whatever stdout/stderr are redirected to):
+ *
+ *   Log::info("game {} won by player {} with {} tiles", game.id, winner, area);
+ *   Log::error("[{}] recv() returned error {} ({}), disconnecting.", where, errno, strerror(errno));
+ *
+ * Each call copies a pointer to the format string, a timestamp, and up to
+ * Log::MaxArgs arguments (integers, floating point, chars, or strings --
+ * which are copied) into a fixed-size Record in a ring buffer owned by the
+ * calling thread. A background thread formats the records ("{}" is
+ * replaced by the next argument) and writes them, Info to stdout and
+ * Warn/Error to stderr.
+ *
+ * Nothing on the calling side blocks: when the ring is full, or the writer
+ * is over its MaxLinesPerSecond budget, records are dropped and counted,
+ * and the writer reports the count the next time it gets to write.
+ *
+ * NOTE: the format string must outlive the log call (use a string literal).
+ */
+
+#include <chrono>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <type_traits>
+
+namespace Log {
+
+enum Level : uint8_t { Info, Warn, Error };
+
+constexpr uint32_t MaxArgs = 6;
+constexpr uint32_t TextSize = 256; // bytes shared by all string arguments of a record
+constexpr uint32_t RingSize = 1024; // records per thread (power of two)
+constexpr uint32_t MaxLinesPerSecond = 1000; // writer budget; excess records are dropped
+
+struct Record {
+	std::chrono::steady_clock::time_point time;
+	char const *format = nullptr;
+	Level level = Info;
+	uint8_t arg_count = 0;
+	uint16_t text_used = 0;
+
+	struct Arg {
+		enum Type : uint8_t { Int, Uint, Double, Char, Text } type;
+		union {
+			int64_t i;
+			uint64_t u;
+			double d;
+			char c;
+			struct { uint16_t offset, length; } text;
+		};
+	} args[MaxArgs];
+
+	char text[TextSize];
+
+	//argument capture (extra arguments beyond MaxArgs are ignored):
+	template< typename T >
+	void add(T const &value) {
+		if (arg_count >= MaxArgs) return;
+		Arg &arg = args[arg_count++];
+		if constexpr (std::is_same< T, char >::value) {
+			arg.type = Arg::Char; arg.c = value;
+		} else if constexpr (std::is_same< T, bool >::value) {
+			arg.type = Arg::Uint; arg.u = value ? 1 : 0;
+		} else if constexpr (std::is_enum< T >::value) {
+			arg.type = Arg::Int; arg.i = int64_t(value);
+		} else if constexpr (std::is_integral< T >::value && std::is_signed< T >::value) {
+			arg.type = Arg::Int; arg.i = int64_t(value);
+		} else if constexpr (std::is_integral< T >::value) {
+			arg.type = Arg::Uint; arg.u = uint64_t(value);
+		} else if constexpr (std::is_floating_point< T >::value) {
+			arg.type = Arg::Double; arg.d = double(value);
+		} else {
+			add_text(arg, std::string(value));
+		}
+	}
+	void add(char const *value) {
+		if (arg_count >= MaxArgs) return;
+		add_text(args[arg_count++], value ? value : "(null)", value ? std::strlen(value) : 6);
+	}
+	void add_text(Arg &arg, std::string const &value) {
+		add_text(arg, value.data(), value.size());
+	}
+	void add_text(Arg &arg, char const *value, size_t length);
+};
+
+//(internals) claim/publish a record in the calling thread's ring; claim returns nullptr if the ring is full:
+Record *claim(Level level, char const *format);
+void publish();
+
+template< typename... Args >
+void write(Level level, char const *format, Args const &... args) {
+	Record *record = claim(level, format);
+	if (!record) return;
+	(record->add(args), ...);
+	publish();
+}
+
+template< typename... Args >
+void info(char const *format, Args const &... args) { write(Info, format, args...); }
+template< typename... Args >
+void warn(char const *format, Args const &... args) { write(Warn, format, args...); }
+template< typename... Args >
+void error(char const *format, Args const &... args) { write(Error, format, args...); }
+
+//wait until everything logged so far (by any thread) has been written:
+void flush();
+
+//records dropped so far because a ring was full or the writer was over budget:
+uint64_t dropped();
+
+} //namespace Log
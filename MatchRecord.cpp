@@ -0,0 +1,82 @@
+#include "MatchRecord.hpp"
+
+#include "read_write_chunk.hpp"
+
+#include <fstream>
+#include <stdexcept>
+
+void MatchRecord::finish(GameSim const &sim) {
+	header.cols = sim.cols;
+	header.rows = sim.rows;
+	header.final_tick = sim.tick;
+	header.final_hash = sim.state_hash();
+	header.winner = sim.winner;
+	header.winner_area = sim.winner_area;
+}
+
+void MatchRecord::save(std::string const &path) const {
+	std::ofstream file(path, std::ios::binary);
+	write_chunk("mrh3", std::vector< Header >(1, header), &file);
+	std::vector< Event > events;
+	events.reserve(event_count);
+	for_each_event([&events](Event const &event) { events.emplace_back(event); });
+	write_chunk("mre2", events, &file);
+	if (!file) {
+		throw std::runtime_error("Failed to write match record '" + path + "'.");
+	}
+}
+
+MatchRecord MatchRecord::load(std::string const &path) {
+	std::ifstream file(path, std::ios::binary);
+	if (!file) {
+		throw std::runtime_error("Failed to open match record '" + path + "'.");
+	}
+	MatchRecord record;
+	std::vector< Header > headers;
+	read_chunk(file, "mrh3", &headers);
+	if (headers.size() != 1) {
+		throw std::runtime_error("Match record '" + path + "' should have exactly one header.");
+	}
+	record.header = headers[0];
+	if (record.header.sim_version != GameSim::Version) {
+		throw std::runtime_error("Match record '" + path + "' was recorded with game rules version " + std::to_string(int(record.header.sim_version))
+			+ ", but this is version " + std::to_string(int(GameSim::Version)) + ".");
+	}
+	std::vector< Event > events;
+	read_chunk(file, "mre2", &events);
+	for (Event const &event : events) {
+		record.add(event.tick, event.type, event.a, event.b);
+	}
+	return record;
+}
+
+void MatchRecord::replay(GameSim &sim) const {
+	Rng rng;
+	rng.seed(header.seed);
+
+	auto step_to = [&sim](uint32_t tick) {
+		while (sim.tick < tick && !sim.game_over) {
+			sim.step();
+			sim.clear_changes();
+		}
+	};
+
+	for_each_event([&](Event const &event) {
+		step_to(event.tick);
+		if (event.type == Event::Join) {
+			sim.add_player(uint8_t(event.a), rng);
+		} else if (event.type == Event::Leave) {
+			sim.remove_player(uint8_t(event.a));
+		} else if (event.type == Event::Input) {
+			sim.set_input(uint8_t(event.a), GameSim::Dir(event.b));
+		} else if (event.type == Event::Borders) {
+			sim.set_borders(event.a, event.b);
+		} else if (event.type == Event::Powerup) {
+			sim.place_powerup(rng);
+		} else {
+			throw std::runtime_error("Unknown event type " + std::to_string(int(event.type)) + " in match record.");
+		}
+		sim.clear_changes();
+	});
+	step_to(header.final_tick);
+}
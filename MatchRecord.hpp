@@ -0,0 +1,112 @@
+#pragma once
+
+/*
+ * MatchRecord is everything needed to re-run a game exactly: the game's
+ * seed and board size, plus every call the server made into its GameSim
+ * (joins, leaves, input changes, border moves, powerup spawns), each
+ * stamped with the sim tick it happened on.
+ *
+ * Since all of a game's randomness comes from an Rng seeded with the
+ * game's seed, replaying the events against a fresh GameSim reproduces
+ * the game tick-for-tick; the final state hash is stored so the re-run
+ * can be checked. Records are only replayed by a GameSim with the same
+ * GameSim::Version as the one that recorded them.
+ *
+ * Files are two chunks in the read_write_chunk.hpp format:
+ *   "mrh3" -- one Header
+ *   "mre2" -- the Events, in the order they happened
+ *
+ * Usage (server):
+
+	record.header.seed = game.seed; //... and the rest of the header
+	record.add(sim.tick, MatchRecord::Event::Input, id, dir); //whenever the server changes the sim
+	//... at the end of the game:
+	record.finish(sim);
+	record.save("recordings/game-1234.match");
+
+ * Usage (replay):
+
+	MatchRecord record = MatchRecord::load("recordings/game-1234.match");
+	GameSim sim(record.header.cols, record.header.rows, record.header.start_size);
+	record.replay(sim);
+	bool same = (sim.state_hash() == record.header.final_hash);
+
+ */
+
+#include "GameSim.hpp"
+
+#include <vector>
+#include <list>
+#include <array>
+#include <memory_resource>
+#include <string>
+#include <cstdint>
+
+struct MatchRecord {
+	struct Header {
+		uint64_t seed = 0;
+		uint64_t final_hash = 0; // sim.state_hash() at the end of the game
+		uint32_t game_id = 0;
+		uint32_t final_tick = 0;
+		uint32_t winner_area = 0;
+		uint16_t cols = GameSim::DefaultCols, rows = GameSim::DefaultRows;
+		uint16_t start_size = GameSim::MinSize;
+		uint8_t players = 0;
+		uint8_t winner = GameSim::NoOwner;
+		uint8_t sim_version = GameSim::Version; // (records from before versions were kept have 0 here)
+		uint8_t padding[3] = {0, 0, 0};
+	};
+	static_assert(sizeof(Header) == 40, "Header is packed");
+
+	struct Event {
+		uint32_t tick; // sim.tick when it happened (i.e., after that many steps)
+		uint16_t a, b;
+		enum Type : uint8_t {
+			Join, // a = player id (uses the game's rng)
+			Leave, // a = player id
+			Input, // a = player id, b = dir
+			Borders, // a = horizontal border, b = vertical border
+			Powerup, // place a powerup (uses the game's rng)
+		} type;
+		uint8_t padding[3];
+	};
+	static_assert(sizeof(Event) == 12, "Event is packed");
+
+	//events are allocated from 'memory' (the server uses the game's arena):
+	explicit MatchRecord(std::pmr::memory_resource *memory = std::pmr::get_default_resource()) : chunks(memory) { }
+
+	Header header;
+
+	//events are stored in fixed-size chunks, so a long game adds chunks rather than regrowing one array
+	// (which, in a monotonic arena, would leave every outgrown copy behind):
+	static constexpr uint32_t ChunkEvents = 512;
+	typedef std::array< Event, ChunkEvents > Chunk;
+	std::pmr::list< Chunk > chunks;
+	size_t event_count = 0;
+
+	void add(uint32_t tick, Event::Type type, uint16_t a = 0, uint16_t b = 0) {
+		if (event_count % ChunkEvents == 0) chunks.emplace_back();
+		chunks.back()[event_count % ChunkEvents] = Event{tick, a, b, type, {0, 0, 0}};
+		event_count += 1;
+	}
+
+	//call f(event) on every event, in order:
+	template< typename F >
+	void for_each_event(F const &f) const {
+		size_t left = event_count;
+		for (Chunk const &chunk : chunks) {
+			for (uint32_t i = 0; i < ChunkEvents && left > 0; ++i, --left) f(chunk[i]);
+		}
+	}
+
+	//note the final state of the game in the header:
+	void finish(GameSim const &sim);
+
+	//write/read a record (throws on failure, including records from another GameSim::Version):
+	void save(std::string const &path) const;
+	static MatchRecord load(std::string const &path);
+
+	//re-run the game on 'sim' (freshly constructed with header.cols, header.rows and header.start_size)
+	// until header.final_tick:
+	void replay(GameSim &sim) const;
+};
@@ -0,0 +1,68 @@
+#include "Matchmaker.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+Matchmaker::Matchmaker(uint32_t players_per_match_) : players_per_match(players_per_match_) {
+	assert(players_per_match >= 1);
+}
+
+void Matchmaker::add(Connection *c) {
+	if (contains(c)) return;
+	queue.emplace_back(Waiting{c, Clock::now()});
+	lookup.emplace(c, std::prev(queue.end()));
+	changed = true;
+}
+
+void Matchmaker::remove(Connection *c) {
+	auto f = lookup.find(c);
+	if (f == lookup.end()) return;
+	queue.erase(f->second);
+	lookup.erase(f);
+	changed = true;
+}
+
+size_t Matchmaker::tick(std::function< void(std::vector< Connection * > const &) > const &start_match) {
+	if (!changed) return 0;
+	changed = false;
+
+	auto now = Clock::now();
+	std::vector< Connection * > match;
+	match.reserve(players_per_match);
+	while (queue.size() >= players_per_match) {
+		match.clear();
+		for (uint32_t i = 0; i < players_per_match; ++i) {
+			Waiting const &w = queue.front();
+			double waited = std::chrono::duration< double >(now - w.since).count();
+			total_wait += waited;
+			max_wait = std::max(max_wait, waited);
+			match.emplace_back(w.connection);
+			lookup.erase(w.connection);
+			queue.pop_front();
+		}
+		matches += 1;
+		matched_players += players_per_match;
+		start_match(match);
+	}
+
+	//one status message per still-waiting connection:
+	uint8_t waiting = uint8_t(std::min< size_t >(queue.size(), 255));
+	for (auto const &w : queue) {
+		w.connection->send('q');
+		w.connection->send(waiting);
+		w.connection->send(uint8_t(players_per_match));
+	}
+	return queue.size();
+}
+
+std::string Matchmaker::stats_summary() const {
+	double mean_wait = (matched_players ? total_wait / matched_players : 0.0);
+	return std::to_string(matches) + " matches, " + std::to_string(queue.size()) + " waiting"
+		+ ", wait mean " + std::to_string(int(mean_wait * 1000.0)) + "ms"
+		+ " max " + std::to_string(int(max_wait * 1000.0)) + "ms";
+}
+
+void Matchmaker::clear_stats() {
+	matches = matched_players = 0;
+	total_wait = max_wait = 0.0;
+}
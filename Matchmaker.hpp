@@ -0,0 +1,54 @@
+#pragma once
+
+/*
+ * Matchmaker holds the queue of connections waiting for a game.
+ *
+ * Joining and leaving the queue are O(1) and don't send anything;
+ * instead, tick() runs once per server tick, forms as many matches as
+ * the queue allows, and then sends each connection still waiting (at
+ * most) one coalesced queue-status message:
+ *   'q' + 1-byte [number waiting] + 1-byte [players per match]
+ */
+
+#include "Connection.hpp"
+
+#include <chrono>
+#include <functional>
+#include <list>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+#include <string>
+
+struct Matchmaker {
+	Matchmaker(uint32_t players_per_match);
+
+	uint32_t players_per_match;
+
+	void add(Connection *c);
+	void remove(Connection *c); //(does nothing if 'c' isn't queued)
+	bool contains(Connection *c) const { return lookup.count(c) != 0; }
+	size_t size() const { return queue.size(); }
+
+	//form matches (oldest-waiting first) and call 'start_match' for each; then send queue status updates
+	// (returns how many status messages were sent, so the caller can count them):
+	size_t tick(std::function< void(std::vector< Connection * > const &) > const &start_match);
+
+	//---- statistics ----
+	uint64_t matches = 0; //matches formed
+	uint64_t matched_players = 0;
+	double total_wait = 0.0; //seconds, summed over matched players
+	double max_wait = 0.0; //seconds
+	std::string stats_summary() const;
+	void clear_stats();
+
+	//internals:
+	typedef std::chrono::steady_clock Clock;
+	struct Waiting {
+		Connection *connection;
+		Clock::time_point since;
+	};
+	std::list< Waiting > queue;
+	std::unordered_map< Connection *, std::list< Waiting >::iterator > lookup;
+	bool changed = false; //queue changed since last status update
+};
@@ -0,0 +1,149 @@
+#include "Metrics.hpp"
+#include "Log.hpp"
+
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <list>
+#include <map>
+#include <fstream>
+#include <cstdio>
+
+namespace Metrics {
+
+struct Entry {
+	enum Type { CounterType, GaugeType, HistogramType } type;
+	std::string name; // (including labels, if any)
+	std::string help;
+	Counter counter;
+	Gauge gauge;
+	Histogram histogram;
+};
+
+struct Registry {
+	std::mutex mutex; // only taken to register or render, never to update
+	std::list< Entry > entries; // (list, so references stay valid)
+	std::map< std::string, Entry * > by_name;
+
+	Entry &find_or_add(std::string const &name, std::string const &help, Entry::Type type) {
+		std::lock_guard< std::mutex > lock(mutex);
+		auto f = by_name.find(name);
+		if (f != by_name.end()) return *f->second;
+		entries.emplace_back();
+		Entry &entry = entries.back();
+		entry.type = type;
+		entry.name = name;
+		entry.help = help;
+		by_name.emplace(name, &entry);
+		return entry;
+	}
+
+	//snapshot writer:
+	std::thread snapshot_thread;
+	std::mutex snapshot_mutex;
+	std::condition_variable snapshot_cv;
+	bool quit = false;
+
+	~Registry() {
+		if (snapshot_thread.joinable()) {
+			{
+				std::lock_guard< std::mutex > lock(snapshot_mutex);
+				quit = true;
+			}
+			snapshot_cv.notify_all();
+			snapshot_thread.join();
+		}
+	}
+};
+
+static Registry &registry() {
+	static Registry r;
+	return r;
+}
+
+Counter &counter(std::string const &name, std::string const &help) {
+	return registry().find_or_add(name, help, Entry::CounterType).counter;
+}
+
+Gauge &gauge(std::string const &name, std::string const &help) {
+	return registry().find_or_add(name, help, Entry::GaugeType).gauge;
+}
+
+Histogram &histogram(std::string const &name, std::string const &help) {
+	return registry().find_or_add(name, help, Entry::HistogramType).histogram;
+}
+
+std::string render() {
+	Registry &r = registry();
+	std::lock_guard< std::mutex > lock(r.mutex);
+
+	std::string out;
+	std::string last_base;
+	//(by_name is sorted, so labelled variants of a metric end up next to each other)
+	for (auto const &named : r.by_name) {
+		Entry const &entry = *named.second;
+		std::string base = entry.name.substr(0, entry.name.find('{'));
+		std::string labels = (base.size() < entry.name.size() ? entry.name.substr(base.size() + 1, entry.name.size() - base.size() - 2) : "");
+
+		if (base != last_base) {
+			out += "# HELP " + base + " " + entry.help + "\n";
+			out += "# TYPE " + base + " ";
+			out += (entry.type == Entry::CounterType ? "counter" : entry.type == Entry::GaugeType ? "gauge" : "histogram");
+			out += "\n";
+			last_base = base;
+		}
+
+		if (entry.type == Entry::CounterType) {
+			out += entry.name + " " + std::to_string(entry.counter.value.load(std::memory_order_relaxed)) + "\n";
+		} else if (entry.type == Entry::GaugeType) {
+			out += entry.name + " " + std::to_string(entry.gauge.value.load(std::memory_order_relaxed)) + "\n";
+		} else {
+			Histogram const &h = entry.histogram;
+			std::string prefix = (labels.empty() ? "" : labels + ",");
+			uint64_t seen = 0;
+			for (uint32_t i = 0; i < Histogram::Buckets; ++i) {
+				seen += h.buckets[i].load(std::memory_order_relaxed);
+				//(bucket i holds values below 2^i, i.e. <= 2^i - 1; the last bucket also holds everything larger)
+				if (i + 1 == Histogram::Buckets) break;
+				out += base + "_bucket{" + prefix + "le=\"" + std::to_string((uint64_t(1) << i) - 1) + "\"} " + std::to_string(seen) + "\n";
+			}
+			out += base + "_bucket{" + prefix + "le=\"+Inf\"} " + std::to_string(seen) + "\n";
+			std::string suffix = (labels.empty() ? "" : "{" + labels + "}");
+			out += base + "_sum" + suffix + " " + std::to_string(h.sum.load(std::memory_order_relaxed)) + "\n";
+			out += base + "_count" + suffix + " " + std::to_string(h.count.load(std::memory_order_relaxed)) + "\n";
+		}
+	}
+	return out;
+}
+
+void write_snapshots(std::string const &path, double interval) {
+	Registry &r = registry();
+	if (r.snapshot_thread.joinable()) {
+		Log::warn("[Metrics] already writing snapshots; ignoring request to write '{}'", path);
+		return;
+	}
+	r.snapshot_thread = std::thread([&r, path, interval](){
+		std::string temp = path + ".tmp";
+		std::unique_lock< std::mutex > lock(r.snapshot_mutex);
+		while (!r.quit) {
+			r.snapshot_cv.wait_for(lock, std::chrono::duration< double >(interval));
+			if (r.quit) break;
+			{
+				std::ofstream file(temp, std::ios::binary);
+				file << render();
+				if (!file) {
+					Log::warn("[Metrics] failed to write '{}'", temp);
+					continue;
+				}
+			}
+			if (std::rename(temp.c_str(), path.c_str()) != 0) {
+				std::remove(path.c_str()); // (windows won't rename over an existing file)
+				if (std::rename(temp.c_str(), path.c_str()) != 0) {
+					Log::warn("[Metrics] failed to rename '{}' to '{}'", temp, path);
+				}
+			}
+		}
+	});
+}
+
+} //namespace Metrics
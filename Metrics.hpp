@@ -0,0 +1,70 @@
+#pragma once
+
+/*
+ * Metrics is a registry of named counters, gauges and histograms, readable
+ * as plain text (in the Prometheus exposition format) via render() or from
+ * a snapshot file that a background thread rewrites periodically.
+ *
+ * Usage:
+
+	//register once (returned references stay valid for the life of the program):
+	static Metrics::Counter &bytes_out = Metrics::counter("server_bytes_out_total", "Bytes queued to clients.");
+	static Metrics::Histogram &tick_us = Metrics::histogram("server_tick_work_us", "Tick work time (microseconds).");
+
+	//update (relaxed atomic operations, so cheap enough to leave on):
+	bytes_out.add(message.size());
+	tick_us.observe(work_us);
+
+	//read:
+	std::string text = Metrics::render();
+
+ * Names may carry labels, e.g. "server_messages_in_total{type=\"b\"}";
+ * metrics that share a base name are listed together under one HELP/TYPE.
+ */
+
+#include <atomic>
+#include <array>
+#include <string>
+#include <cstdint>
+
+namespace Metrics {
+
+struct Counter {
+	void add(uint64_t amount = 1) { value.fetch_add(amount, std::memory_order_relaxed); }
+	std::atomic< uint64_t > value{0};
+};
+
+struct Gauge {
+	void set(int64_t to) { value.store(to, std::memory_order_relaxed); }
+	void add(int64_t amount) { value.fetch_add(amount, std::memory_order_relaxed); }
+	std::atomic< int64_t > value{0};
+};
+
+//power-of-two buckets: bucket i counts values in [2^(i-1), 2^i) (bucket 0 counts zeros, the last bucket everything too large):
+struct Histogram {
+	static constexpr uint32_t Buckets = 24;
+	void observe(uint64_t value) {
+		uint32_t bucket = 0;
+		for (uint64_t v = value; v > 0 && bucket + 1 < Buckets; v >>= 1) bucket += 1;
+		buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+		count.fetch_add(1, std::memory_order_relaxed);
+		sum.fetch_add(value, std::memory_order_relaxed);
+	}
+	std::array< std::atomic< uint64_t >, Buckets > buckets{};
+	std::atomic< uint64_t > count{0};
+	std::atomic< uint64_t > sum{0};
+};
+
+//find or create a metric (registering the same name twice returns the same metric):
+Counter &counter(std::string const &name, std::string const &help);
+Gauge &gauge(std::string const &name, std::string const &help);
+Histogram &histogram(std::string const &name, std::string const &help);
+
+//all metrics, as text:
+std::string render();
+
+//rewrite 'path' with render() every 'interval' seconds, from a background thread
+// (the file is written next to 'path' and renamed over it, so readers never see half a snapshot):
+void write_snapshots(std::string const &path, double interval);
+
+} //namespace Metrics
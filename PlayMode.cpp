@@ -18,6 +18,9 @@
 
 #include <random>
 #include <queue>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
 
 Load< Sound::Sample > background_sample(LoadTagDefault, []() -> Sound::Sample const * {
 	return new Sound::Sample(data_path("background_track.opus"));
@@ -164,6 +167,7 @@ PlayMode::PlayMode(Client &client_) : client(client_) {
 	}
 	
 	init_tiles();
+	init_palette();
 
 	// start background music 
 	Sound::loop(*background_sample, 0.1f, 0.0f);
@@ -192,17 +196,40 @@ bool PlayMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size)
 				gameState = QUEUEING;
 				return true;
 			}
+			if (gameState == SPECTATING) {
+				client.connections.back().send('d');
+				reset_state();
+				spectated_game = 0;
+				gameState = MAIN_MENU;
+				return true;
+			}
 			if (gameState == MAIN_MENU) {
 				client.connections.back().send('q');
 				gameState = QUEUEING;
 				return true;
 			}
 		}
+		else if (evt.key.keysym.sym == SDLK_v) {
+			if (gameState == MAIN_MENU) {
+				// watch whichever game the server picks:
+				client.connections.back().send('v');
+				client.connections.back().send(uint32_t(0));
+				local_id = SPECTATOR_ID;
+				gameState = SPECTATING;
+				return true;
+			}
+		}
 	}
 	return false;
 }
 
 void PlayMode::update(float elapsed) {
+	clock += elapsed;
+
+	if (gameState == SPECTATING && !GAME_OVER) {
+		update_powerup(elapsed);
+	}
+
 	if (gameState == IN_GAME) {
 		if (GAME_OVER) {
 			return;
@@ -213,23 +240,33 @@ void PlayMode::update(float elapsed) {
 		//queue data for sending to server:
 		const uint8_t *key = SDL_GetKeyboardState(NULL);
 		Dir dir = none;
+		Player const *local = find_player(local_id);
+		bool fast = (local && local->powerup_type == speed);
 		if (key[SDL_SCANCODE_LEFT] || key[SDL_SCANCODE_A]) {
-			if (players.at(local_id).powerup_type == speed) dir = ll;
+			if (fast) dir = ll;
 			else dir = left;
 		} else if (key[SDL_SCANCODE_RIGHT] || key[SDL_SCANCODE_D]) {
-			if (players.at(local_id).powerup_type == speed) dir = rr;
+			if (fast) dir = rr;
 			else dir = right;
 		} else if (key[SDL_SCANCODE_UP] || key[SDL_SCANCODE_W]) {
-			if (players.at(local_id).powerup_type == speed) dir = uu;
+			if (fast) dir = uu;
 			else dir = up;
 		} else if (key[SDL_SCANCODE_DOWN] || key[SDL_SCANCODE_S]) {
-			if (players.at(local_id).powerup_type == speed) dir = dd;
+			if (fast) dir = dd;
 			else dir = down;
 		}
 
-		//send a two-byte message of type 'b':
-		client.connections.back().send('b');
-		client.connections.back().send((uint8_t)dir);
+		//face the new direction this frame, even though the move waits for the next tick:
+		if (dir != none && local) players[local_id].dir = dir;
+
+		//one input per server tick, sent a little faster or slower to keep about one waiting in the server's queue
+		// (an empty queue means the server moves the player without an input, a long one delays every input):
+		tick_timer -= elapsed;
+		if (tick_timer <= 0.0f) {
+			float pace = (inputs_queued == 0 ? 0.97f : inputs_queued >= 2 ? 1.03f : 1.0f);
+			tick_timer = std::max(0.0f, tick_timer + pace * tick_interval);
+			predict_tick(dir);
+		}
 	}
 
 	//send/receive data:
@@ -253,50 +290,133 @@ void PlayMode::update(float elapsed) {
 				if (type == 'a') {
 					uint32_t num_players = uint8_t(c->recv_buffer[1]);
 					//std::cout << "num_players=" << num_players << std::endl;
-					if (c->recv_buffer.size() < 2 + num_players * 4) break; //if whole message isn't here, can't process
+					if (c->recv_buffer.size() < 2 + num_players * 11) break; //if whole message isn't here, can't process
 					//whole message *is* here, so set current server message:
 
-					if (gameState == IN_GAME) {
-						uint8_t byte_index = 2;
+					if (gameState == IN_GAME || gameState == SPECTATING) {
+						//updates come once per server tick, which paces the inputs sent (see predict_tick) and
+						// the interpolation of other players (see update_interpolation):
+						if (last_update_at >= 0.0f) {
+							float interval = clock - last_update_at;
+							tick_interval = std::min(std::max(0.95f * tick_interval + 0.05f * interval, 0.02f), 1.0f);
+							update_jitter = 0.9f * update_jitter + 0.1f * std::abs(interval - tick_interval);
+						}
+						last_update_at = clock;
+						updates_received += 1;
+
+						// (the board's copy of the players is only used for board_hash(), so it tracks exactly who was listed)
+						for (auto &p : board.players) p.active = false;
+						uint32_t byte_index = 2;
 						for (uint32_t k = 0; k < num_players; k++) {
 							uint8_t id = c->recv_buffer[byte_index++];
 							uint8_t dir = c->recv_buffer[byte_index++];
-							uint8_t x = c->recv_buffer[byte_index++];
-							uint8_t y = c->recv_buffer[byte_index++];
+							uint16_t x, y;
+							std::memcpy(&x, c->recv_buffer.data() + byte_index, sizeof(x));
+							byte_index += sizeof(x);
+							std::memcpy(&y, c->recv_buffer.data() + byte_index, sizeof(y));
+							byte_index += sizeof(y);
+							uint8_t powerup_type = c->recv_buffer[byte_index++];
+							uint32_t area;
+							std::memcpy(&area, c->recv_buffer.data() + byte_index, sizeof(area));
+							byte_index += sizeof(area);
 							glm::vec2 pos = glm::vec2(x, y);
 
-							auto player = players.find(id);
-							if (player == players.end()) {
+							if (id >= GameSim::MaxPlayers) {
+								throw std::runtime_error("Server sent a bad player id");
+							}
+							if (board.players.size() <= id) board.players.resize(id + 1);
+							GameSim::Pos before = board.players[id].pos;
+							board.players[id].active = true;
+							board.players[id].pos.x = x;
+							board.players[id].pos.y = y;
+
+							Player *player = find_player(id);
+							if (!player) {
 								Sound::play(*connect_sample, 1.0f, 0.0f);
 								create_player(id, (PlayMode::Dir)dir, pos);
+								player = find_player(id);
 							}
-							else {
-								Player* p = &player->second;
-								// std::cout << p->pos.x << ' ' << p->pos.y << ' ' << pos.x << ' ' << pos.y << '\n';
-								if (std::abs((int)p->pos.x - (int)pos.x) > 1 ||
-									std::abs((int)p->pos.y - (int)pos.y) > 1) { // moved 2 tiles
-									update_player(p, (PlayMode::Dir)dir, glm::vec2((p->pos.x + pos.x) / 2,
-															(p->pos.y + pos.y) / 2), elapsed);
-								}
-								update_player(p, (PlayMode::Dir)dir, pos, elapsed);
+							if (id == local_id) {
+								// (the local player is shown where the prediction puts them, facing the way they're steering)
+								bool moving = (before != board.players[id].pos);
+								update_player(player, none, reconcile(pos), moving, (PlayMode::PowerupType)powerup_type, area, elapsed);
+							} else {
+								update_player(player, (PlayMode::Dir)dir, pos, player->pos != glm::uvec2(pos), (PlayMode::PowerupType)powerup_type, area, elapsed);
+								add_snapshot(player, pos);
 							}
 						}
 					}
 					//and consume this part of the buffer:
-					c->recv_buffer.erase(c->recv_buffer.begin(), c->recv_buffer.begin() + 2 + num_players * 4);
+					c->recv_buffer.erase(c->recv_buffer.begin(), c->recv_buffer.begin() + 2 + num_players * 11);
 				}
-				else if (type == 'g') {
+				else if (type == 't') { // tiles changed: 2-byte count + count * (2-byte x, 2-byte y, kind, owner)
 					if (c->recv_buffer.size() < 3) break; //if whole message isn't here, can't process
+					uint16_t count;
+					std::memcpy(&count, c->recv_buffer.data() + 1, sizeof(count));
+					if (c->recv_buffer.size() < 3 + count * 6U) break;
+
+					for (uint32_t k = 0; k < count; k++) {
+						char const *tile = c->recv_buffer.data() + 3 + k * 6;
+						uint16_t x, y;
+						std::memcpy(&x, tile, sizeof(x));
+						std::memcpy(&y, tile + 2, sizeof(y));
+						uint8_t kind = uint8_t(tile[4]);
+						if (x >= board.cols || y >= board.rows || kind > GameSim::Tile::Territory) {
+							throw std::runtime_error("Server sent a bad tile update");
+						}
+						board.set_tile(x, y, GameSim::Tile::Kind(kind), uint8_t(tile[5]));
+					}
 
-					horizontal_border = c->recv_buffer[1];
-					vertical_border = c->recv_buffer[2];
-
-					c->recv_buffer.erase(c->recv_buffer.begin(), c->recv_buffer.begin() + 3);
+					c->recv_buffer.erase(c->recv_buffer.begin(), c->recv_buffer.begin() + 3 + count * 6);
+				}
+				else if (type == 'w') { // game won: winner + 4-byte area
+					if (c->recv_buffer.size() < 6) break; //if whole message isn't here, can't process
+					uint32_t area;
+					std::memcpy(&area, c->recv_buffer.data() + 2, sizeof(area));
+					win_game(c->recv_buffer[1], area);
+					c->recv_buffer.erase(c->recv_buffer.begin(), c->recv_buffer.begin() + 6);
+				}
+				else if (type == 'g') { // walls moved: 2-byte horizontal + 2-byte vertical border
+					if (c->recv_buffer.size() < 5) break; //if whole message isn't here, can't process
+					uint16_t horizontal, vertical;
+					std::memcpy(&horizontal, c->recv_buffer.data() + 1, sizeof(horizontal));
+					std::memcpy(&vertical, c->recv_buffer.data() + 3, sizeof(vertical));
+					board.set_borders(horizontal, vertical);
+					c->recv_buffer.erase(c->recv_buffer.begin(), c->recv_buffer.begin() + 5);
+				}
+				else if (type == 'm') { // board size for this game: 2-byte cols + 2-byte rows (starts an empty board)
+					if (c->recv_buffer.size() < 5) break; //if whole message isn't here, can't process
+					uint16_t cols, rows;
+					std::memcpy(&cols, c->recv_buffer.data() + 1, sizeof(cols));
+					std::memcpy(&rows, c->recv_buffer.data() + 3, sizeof(rows));
+					if (cols < GameSim::MinSize || cols > GameSim::MaxSize || rows < GameSim::MinSize || rows > GameSim::MaxSize) {
+						throw std::runtime_error("Server sent a bad board size");
+					}
+					resize_board(cols, rows);
+					c->recv_buffer.erase(c->recv_buffer.begin(), c->recv_buffer.begin() + 5);
+				}
+				else if (type == 'y') { // inputs the following update reflects: 2-byte count of 'b' messages applied + 1-byte count still queued
+					if (c->recv_buffer.size() < 4) break; //if whole message isn't here, can't process
+					std::memcpy(&inputs_acked, c->recv_buffer.data() + 1, sizeof(inputs_acked));
+					inputs_queued = uint8_t(c->recv_buffer[3]);
+					c->recv_buffer.erase(c->recv_buffer.begin(), c->recv_buffer.begin() + 4);
+				}
+				else if (type == 'k') { // hash check: 4-byte tick; players answer with their board's hash
+					if (c->recv_buffer.size() < 5) break; //if whole message isn't here, can't process
+					uint32_t tick;
+					std::memcpy(&tick, c->recv_buffer.data() + 1, sizeof(tick));
+					if (gameState == IN_GAME) {
+						c->send('h');
+						c->send(tick);
+						c->send(board.board_hash());
+					}
+					c->recv_buffer.erase(c->recv_buffer.begin(), c->recv_buffer.begin() + 5);
 				}
 				else if (type == 'i') {
 					if (c->recv_buffer.size() < 2) break; //if whole message isn't here, can't process
 					local_id = c->recv_buffer[1];
 					gameState = IN_GAME;
+					reset_prediction();
 					c->recv_buffer.erase(c->recv_buffer.begin(), c->recv_buffer.begin() + 2);
 				}
 				else if (type == 's') { // start countdown update
@@ -304,27 +424,33 @@ void PlayMode::update(float elapsed) {
 					start_countdown = c->recv_buffer[1];
 					c->recv_buffer.erase(c->recv_buffer.begin(), c->recv_buffer.begin() + 2);
 				}
+				else if (type == 'v') { // now spectating game (id 0 = no game running)
+					if (c->recv_buffer.size() < 5) break; //if whole message isn't here, can't process
+					uint32_t id;
+					std::memcpy(&id, c->recv_buffer.data() + 1, sizeof(id));
+					if (id != spectated_game) {
+						// switched to a different game (e.g. the previous one ended), so start from a clean board:
+						reset_state();
+						spectated_game = id;
+					}
+					c->recv_buffer.erase(c->recv_buffer.begin(), c->recv_buffer.begin() + 5);
+				}
 				else if (type == 'q') { // queue update
-					if (c->recv_buffer.size() < 2) break; //if whole message isn't here, can't process
+					if (c->recv_buffer.size() < 3) break; //if whole message isn't here, can't process
 					lobby_size = c->recv_buffer[1];
-					c->recv_buffer.erase(c->recv_buffer.begin(), c->recv_buffer.begin() + 2);
-				}
-				else if (type == 'l') { // server request powerup location
-					c->send('l');
-					glm::uvec2 loc = get_new_powerup_location();
-					c->send((uint8_t) loc.x);
-					c->send((uint8_t) loc.y);
-					c->recv_buffer.erase(c->recv_buffer.begin(), c->recv_buffer.begin() + 1);
+					lobby_target = c->recv_buffer[2];
+					c->recv_buffer.erase(c->recv_buffer.begin(), c->recv_buffer.begin() + 3);
 				}
-				else if (type == 'p') {
-					if (c->recv_buffer.size() < 4) break;
+				else if (type == 'p') { // powerup: type + 2-byte x + 2-byte y
+					if (c->recv_buffer.size() < 6) break;
 
 					PowerupType type = (PowerupType) c->recv_buffer[1];
-					uint8_t x = c->recv_buffer[2];
-					uint8_t y = c->recv_buffer[3];
+					uint16_t x, y;
+					std::memcpy(&x, c->recv_buffer.data() + 2, sizeof(x));
+					std::memcpy(&y, c->recv_buffer.data() + 4, sizeof(y));
 					new_powerup(type, glm::uvec2(x, y));
 
-					c->recv_buffer.erase(c->recv_buffer.begin(), c->recv_buffer.begin() + 4);
+					c->recv_buffer.erase(c->recv_buffer.begin(), c->recv_buffer.begin() + 6);
 				}
 				else {
 					throw std::runtime_error("Server sent unknown message type '" + std::to_string(type) + "'");
@@ -332,6 +458,11 @@ void PlayMode::update(float elapsed) {
 			}
 		}
 	}, 0.0);
+
+	//(the client doesn't need the board's change list)
+	board.clear_changes();
+
+	update_interpolation(elapsed);
 }
 
 void PlayMode::draw(glm::uvec2 const &drawable_size) {
@@ -341,7 +472,7 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 
 	//compute area that should be visible:
 	glm::vec2 scene_min = glm::vec2(-PADDING, -PADDING);
-	glm::vec2 scene_max = glm::vec2(GRID_W+PADDING, GRID_H+PADDING);
+	glm::vec2 scene_max = glm::vec2(grid_w()+PADDING, grid_h()+PADDING);
 
 	//compute window aspect ratio:
 	float aspect = drawable_size.x / float(drawable_size.y);
@@ -386,30 +517,52 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 	switch(gameState) {
 		case MAIN_MENU:
 			draw_splash(splash_vertices);
-			draw_text(vertices, "PRESS SPACE TO ENTER QUEUE", glm::vec2(0.5f * GRID_W, 0.5f * GRID_H - 150.0f), glm::u8vec4(255, 255, 255, 255));
+			draw_text(vertices, "PRESS SPACE TO ENTER QUEUE", glm::vec2(0.5f * grid_w(), 0.5f * grid_h() - 150.0f), glm::u8vec4(255, 255, 255, 255));
+			draw_text(vertices, "PRESS V TO SPECTATE", glm::vec2(0.5f * grid_w(), 0.5f * grid_h() - 220.0f), glm::u8vec4(255, 255, 255, 255));
 			break;
 		case QUEUEING:
-			draw_text(vertices, "QUEUEING...", glm::vec2(0.5f * NUM_COLS * TILE_SIZE, 0.5 * NUM_ROWS * TILE_SIZE + 20.0f), glm::u8vec4(255, 255, 255, 255));
-			draw_text(vertices, std::to_string(lobby_size) + "/2 PLAYERS", glm::vec2(0.5f * NUM_COLS * TILE_SIZE, 0.5 * NUM_ROWS * TILE_SIZE - 20.0f), glm::u8vec4(255, 255, 255, 255));
+			draw_text(vertices, "QUEUEING...", glm::vec2(0.5f * grid_w(), 0.5 * grid_h() + 20.0f), glm::u8vec4(255, 255, 255, 255));
+			draw_text(vertices, std::to_string(lobby_size) + "/" + std::to_string(lobby_target) + " PLAYERS", glm::vec2(0.5f * grid_w(), 0.5 * grid_h() - 20.0f), glm::u8vec4(255, 255, 255, 255));
 			break;
+		case SPECTATING:
+			if (spectated_game == 0) {
+				draw_text(vertices, "NO GAMES RUNNING", glm::vec2(0.5f * grid_w(), 0.5f * grid_h()), glm::u8vec4(255, 255, 255, 255));
+				draw_text(vertices, "PRESS SPACE TO GO BACK", glm::vec2(0.5f * grid_w(), 0.5f * grid_h() - 80.0f), glm::u8vec4(255, 255, 255, 255));
+				break;
+			}
+			[[fallthrough]];
 		case IN_GAME:
 			draw_tiles(vertices);
 			draw_players(vertices);
 			if (GAME_OVER) {
 				std::string msg = "PLAYER " + std::to_string(winner_id) + " WON";
-				draw_text(vertices, msg, glm::vec2(GRID_W * 0.5f, GRID_H * 0.5f), hex_to_color_vec(player_colors[winner_id]));
-				draw_text(vertices, "PRESS SPACE TO PLAY AGAIN", glm::vec2(GRID_W * 0.5f, GRID_H * 0.5f - 80.0f), glm::u8vec4(255, 255, 255, 255));
+				draw_text(vertices, msg, glm::vec2(grid_w() * 0.5f, grid_h() * 0.5f), hex_to_color_vec(player_colors[winner_id]));
+				if (gameState == SPECTATING) {
+					draw_text(vertices, "PRESS SPACE TO GO BACK", glm::vec2(grid_w() * 0.5f, grid_h() * 0.5f - 80.0f), glm::u8vec4(255, 255, 255, 255));
+				} else {
+					draw_text(vertices, "PRESS SPACE TO PLAY AGAIN", glm::vec2(grid_w() * 0.5f, grid_h() * 0.5f - 80.0f), glm::u8vec4(255, 255, 255, 255));
+				}
 			} 
-			size_t num_players = players.size();
-			size_t i = 0;
-			for (auto &[id, player] : players) {
-				std::string msg = std::to_string((player.area * 100) / (NUM_ROWS * NUM_COLS)) + "%";
-				draw_text(vertices, msg, glm::vec2((i + 1) * NUM_COLS * TILE_SIZE / (num_players + 1), (NUM_ROWS - 2.0f) * TILE_SIZE), hex_to_color_vec(player_colors[id]));
-				i++;
+			std::vector< Player const * > listed;
+			for (auto const &player : players) {
+				if (player.active) listed.emplace_back(&player);
+			}
+			// (with lots of players, only the largest territories are listed)
+			if (listed.size() > SPRITE_PLAYERS) {
+				std::partial_sort(listed.begin(), listed.begin() + SPRITE_PLAYERS, listed.end(), [](Player const *a, Player const *b) {
+					return a->area > b->area;
+				});
+				listed.resize(SPRITE_PLAYERS);
+			}
+			size_t num_players = listed.size();
+			for (size_t i = 0; i < num_players; i++) {
+				Player const &player = *listed[i];
+				std::string msg = std::to_string((player.area * 100) / (board.rows * board.cols)) + "%";
+				draw_text(vertices, msg, glm::vec2((i + 1) * grid_w() / (num_players + 1), (board.rows - 2.0f) * TILE_SIZE), hex_to_color_vec(player.color));
 			}
 			if (start_countdown > 0) {
 				std::string msg = std::to_string(start_countdown / 10 + 1);
-				draw_text(vertices, msg, glm::vec2(0.5f * NUM_COLS * TILE_SIZE, 0.5 * NUM_ROWS * TILE_SIZE), glm::u8vec4(255, 255, 255, 255));
+				draw_text(vertices, msg, glm::vec2(0.5f * grid_w(), 0.5 * grid_h()), glm::u8vec4(255, 255, 255, 255));
 			}
 			break;
 	}
@@ -505,33 +658,30 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 	// { 	
 	// 	DrawBackground background(court_to_clip);
 	// 	background.draw(
-	// 		glm::vec2(GRID_W, GRID_H),
+	// 		glm::vec2(grid_w(), grid_h()),
 	// 		hex_to_color_vec(white_color));
 		
 	// }
 
 	// draw the bloom light
-	if (gameState == IN_GAME) { 	
-		for (auto& [id, player] : players) {
-			uint32_t trail_color = trail_colors[id];
+	if (gameState == IN_GAME || gameState == SPECTATING) { 	
+		for (auto& player : players) {
+			if (!player.active) continue;
+			uint32_t trail_color = trail_colors[player.id];
 			DrawBloom bloom(court_to_clip);
 			bloom.draw(
-				(glm::vec2(player.pos) + glm::vec2(0.5f, 0.5f))*TILE_SIZE,
+				(player.draw_pos + glm::vec2(0.5f, 0.5f))*TILE_SIZE,
 				600.0f,
 				hex_to_color_vec(trail_color & 0xffffff8f));
 		}
 
-		for (int x = 0; x < NUM_COLS; x++) {
-			for (int y = 0; y < NUM_ROWS; y++) {
-				if (tiles[x][y].powerup.type != no_powerup) {
-					uint32_t powerup_color = powerup_colors.at(tiles[x][y].powerup.type);
-					DrawBloom bloom(court_to_clip);
-					bloom.draw(
-						(glm::vec2(x, y) + glm::vec2(0.5f, 0.5f))*TILE_SIZE,
-						100.0f,
-						hex_to_color_vec(powerup_color & 0xffffff8f));
-				}
-			}
+		if (powerup.type != no_powerup) {
+			uint32_t powerup_color = powerup_colors.at(powerup.type);
+			DrawBloom bloom(court_to_clip);
+			bloom.draw(
+				(glm::vec2(powerup_pos) + glm::vec2(0.5f, 0.5f))*TILE_SIZE,
+				100.0f,
+				hex_to_color_vec(powerup_color & 0xffffff8f));
 		}
 	}
 
@@ -550,54 +700,74 @@ glm::u8vec4 PlayMode::hex_to_color_vec(int color_hex) {
 }
 
 void PlayMode::reset_state() {
-	tiles.clear();
+	board = GameSim();
 	visual_board.clear();
 	init_tiles();
+	powerup = Powerup(no_powerup);
 	lobby_size = 0;
 	GAME_OVER = false;
 	players.clear();
-	for (int col = 0; col < NUM_COLS; col++) {
-		for (int row = 0; row < NUM_ROWS; row++) {
-			if (tiles[col][row].color != base_color) std::cout << "jfkdsjlf" << std::endl;
-			if (tiles[col][row].age != 0) std::cout << "age !=0 " << std::endl;
-		}
+	updates_received = 0;
+	render_tick = 0.0f;
+	last_update_at = -1.0f;
+}
+
+void PlayMode::resize_board(uint16_t cols, uint16_t rows) {
+	board = GameSim(cols, rows);
+	visual_board.clear();
+	init_tiles();
+}
+
+void PlayMode::init_palette() {
+	//evenly spread hues (golden ratio steps) for players past the hand-picked ones;
+	// trails are a lighter version of the player's color:
+	auto hsv = [](float h, float s, float v) -> uint32_t {
+		auto channel = [&](float offset) {
+			float k = std::fmod(h * 6.0f + offset, 6.0f);
+			float c = std::min(std::max(std::min(k, 4.0f - k), 0.0f), 1.0f);
+			return uint32_t(255.0f * v * (1.0f - s * c));
+		};
+		return (channel(5.0f) << 24) | (channel(3.0f) << 16) | (channel(1.0f) << 8) | 0xff;
+	};
+	float hue = 0.0f;
+	for (uint32_t id = uint32_t(player_colors.size()); id < GameSim::MaxPlayers; ++id) {
+		hue = std::fmod(hue + 0.618034f, 1.0f);
+		player_colors.emplace_back(hsv(hue, 0.9f, 0.85f));
+		trail_colors.emplace_back(hsv(hue, 0.45f, 1.0f));
 	}
 }
 
 void PlayMode::init_tiles() {
-	for (int col = 0; col < NUM_COLS; col++) {
-		std::vector<Tile> tile_col;
+	for (int col = 0; col < board.cols; col++) {
 		std::vector<uint32_t> visual_board_col;
-		for (int row = 0; row < NUM_ROWS; row++) {
-			tile_col.emplace_back(base_color, 0);
+		for (int row = 0; row < board.rows; row++) {
 			visual_board_col.push_back(base_color);
 		}
-		tiles.push_back(tile_col);
 		visual_board.push_back(visual_board_col);
 	}
 }
 
-void PlayMode::create_player(uint8_t id, Dir dir, glm::uvec2 pos) {
-	Player new_player = { id, player_colors[id], pos };
-
-	new_player.prev_pos[0] = pos;
-	new_player.prev_pos[1] = pos;
-
-	tiles[(uint8_t)pos.x][(uint8_t)pos.y].color = trail_colors[id];
-
-	players.insert({ id, new_player });
+uint32_t PlayMode::tile_color(GameSim::Tile const &tile) {
+	if (tile.kind == GameSim::Tile::Trail) return trail_colors[tile.owner];
+	if (tile.kind == GameSim::Tile::Territory) return player_colors[tile.owner];
+	return base_color;
 }
 
-void PlayMode::update_player(Player* p, Dir dir, glm::uvec2 pos, float elapsed) {
-	uint8_t x = pos.x;
-	uint8_t y = pos.y;
-	uint8_t id = p->id;
+void PlayMode::create_player(uint8_t id, Dir dir, glm::uvec2 pos) {
+	if (players.size() <= id) players.resize(id + 1);
+	Player &player = players[id];
+	player = Player();
+	player.active = true;
+	player.id = id;
+	player.color = player_colors[id];
+	player.pos = pos;
+	player.draw_pos = pos;
+	// (predictions start from where the local player spawned)
+	if (id == local_id) predicted_pos = pos;
+}
 
-	bool moving = p->pos != pos;
-	// position changed, shift it into prev_pos
+void PlayMode::update_player(Player* p, Dir dir, glm::uvec2 pos, bool moving, PowerupType powerup_type, uint32_t area, float elapsed) {
 	if (moving) {
-		p->prev_pos[1] = p->prev_pos[0];
-		p->prev_pos[0] = p->pos;
 		// update walk frame
 		float next_frame = p->walk_frame + 2.0f * elapsed / 0.1f;
 		while (next_frame > 2.0f) { next_frame -= 2.0f;}
@@ -611,145 +781,129 @@ void PlayMode::update_player(Player* p, Dir dir, glm::uvec2 pos, float elapsed)
 	// update player's position
 	p->pos = pos;
 	if (dir != none) { p->dir = dir; }
+	p->powerup_type = powerup_type;
 
-	// update and trim player's trails
-	for (int col = 0; col < NUM_COLS; col++) {
-		for (int row = 0; row < NUM_ROWS; row++) {
-			if (tiles[col][row].color == trail_colors[id]) {
-				tiles[col][row].age++;
-				if (p->powerup_type == trail) {
-					if (tiles[col][row].age >= TRAIL_MAX_LEN + TRAIL_POWERUP_LEN)
-						tiles[col][row].color = base_color;
-				}
-				else {
-					if (tiles[col][row].age >= TRAIL_MAX_LEN)
-						tiles[col][row].color = base_color;
-				}
-			}
-		}
+	// player captured territory
+	if (area > p->area) {
+		Sound::play(*success_sample, (p->id == local_id) ? 0.3f : 0.0f, 0.0f); 
 	}
+	p->area = area;
+}
 
-	// player gets powerup
-	if (tiles[x][y].powerup.type != no_powerup) {
-		p->powerup_type = tiles[x][y].powerup.type;
-		// std::cout << tiles[x][y].powerup;
-		tiles[x][y].powerup.type = no_powerup;
-		
-	}
-
-	// player enters their own territory
-	if (tiles[x][y].color == player_colors[id]) {
-		// update player's territory and clear player's trail
-		uint32_t trail_size = 0;
-		for (int col = 0; col < NUM_COLS; col++) {
-			for (int row = 0; row < NUM_ROWS; row++) {
-				if (tiles[col][row].color == trail_colors[id]) {
-					tiles[col][row].color = player_colors[id];
-					trail_size++;
-				}
-			}
-		}
-
-		uint32_t territory_size = 0; uint32_t delta_size = 0;
-		fill_interior(player_colors[id], delta_size, territory_size);
-		if (moving && (delta_size + trail_size) > 0) { 
-			Sound::play(*success_sample, (p->id == local_id) ? 0.3f : 0.0f, 0.0f); 
-		}
-
-		update_areas();
+void PlayMode::reset_prediction() {
+	inputs_sent = 0;
+	inputs_acked = 0;
+	inputs_queued = 1;
+	tick_timer = 0.0f;
+	last_update_at = -1.0f;
+	predicted_pos = glm::uvec2(0, 0); // (set from the spawn position in create_player)
+	start_countdown = 30; // (new games count down 30 ticks before anyone moves, see server.cpp; 's' takes it from here)
+}
 
-		// check if player has won
-		if (territory_size > WIN_THRESHOLD) {
-			win_game(id, territory_size);
-		}
+void PlayMode::predict_tick(Dir dir) {
+	//send a two-byte message of type 'b':
+	client.connections.back().send('b');
+	client.connections.back().send((uint8_t)dir);
+	inputs_sent += 1;
+
+	PredictedInput &input = predictions[inputs_sent % PredictionCapacity];
+	input.dir = dir;
+	input.stepped = (start_countdown == 0);
+	Player *local = find_player(local_id);
+	if (local && input.stepped) {
+		GameSim::Pos pos;
+		pos.x = uint16_t(predicted_pos.x);
+		pos.y = uint16_t(predicted_pos.y);
+		pos = board.predict_move(pos, GameSim::Dir(dir));
+		predicted_pos = glm::uvec2(pos.x, pos.y);
+		local->pos = predicted_pos;
 	}
-	// player hits their own trail
-	else if (tiles[x][y].color == trail_colors[id]) {
-		// update trail age
-		tiles[x][y].age = 0;
-
-		if (moving) {
-			// create allowed_tiles -> player's trail - previous tile
-			std::vector< glm::uvec2 > allowed_tiles;
-			for (int col = 0; col < NUM_COLS; col++) {
-				for (int row = 0; row < NUM_ROWS; row++) {
-					if (tiles[col][row].color == trail_colors[id]) {
-						glm::uvec2 allowed_pos = glm::uvec2(col, row);
-						// disconnect loop, so that the shortest path has to go the long way around the loop
-						if (allowed_pos != p->prev_pos[0])
-							allowed_tiles.emplace_back(col, row);
-					}
-				}
-			}
-
-			// find shortest path "around" the loop
-			std::vector<glm::uvec2> path = shortest_path(p->prev_pos[1], pos, allowed_tiles);
-			assert(path.size() > 0 && "path around loop must exist"); // assert a path exists
-			// reconnect loop
-			path.push_back(p->prev_pos[0]);
-
-			// clear player's trail
-			allowed_tiles.push_back(p->prev_pos[0]); // re-add previous tile
-			for (auto allowed_pos : allowed_tiles) {
-				if (tiles[(uint8_t)allowed_pos.x][(uint8_t)allowed_pos.y].color == trail_colors[id])
-					tiles[(uint8_t)allowed_pos.x][(uint8_t)allowed_pos.y].color = base_color;
-			}
-
-			// add loop to territory
-			uint32_t trail_size = 0;
-			for (glm::uvec2 pos : path) {
-				tiles[(uint8_t)pos.x][(uint8_t)pos.y].color = player_colors[id];
-				trail_size++;
-			}
+	input.pos = predicted_pos;
+}
 
-			uint32_t territory_size = 0; uint32_t delta_size = 0;
-			fill_interior(player_colors[id], delta_size, territory_size);
-			if (moving && (trail_size + delta_size) > 0) { 
-				Sound::play(*success_sample, (p->id == local_id) ? 0.3f : 0.0f, 0.0f); 
-			}
+glm::uvec2 PlayMode::reconcile(glm::uvec2 server_pos) {
+	uint16_t pending = uint16_t(inputs_sent - inputs_acked);
+	if (pending >= PredictionCapacity) {
+		// (too far ahead of the server to replay, so just follow it)
+		predicted_pos = server_pos;
+		return predicted_pos;
+	}
+	// the prediction for the newest input the server has applied should put the player where the server did:
+	if (inputs_acked != 0 && predictions[inputs_acked % PredictionCapacity].pos == server_pos) {
+		return predicted_pos;
+	}
+	// ...it didn't (or there's no prediction yet), so start over from the server's position and redo the rest:
+	GameSim::Pos pos;
+	pos.x = uint16_t(server_pos.x);
+	pos.y = uint16_t(server_pos.y);
+	for (uint16_t i = 1; i <= pending; ++i) {
+		PredictedInput &input = predictions[uint16_t(inputs_acked + i) % PredictionCapacity];
+		if (input.stepped) pos = board.predict_move(pos, GameSim::Dir(input.dir));
+		input.pos = glm::uvec2(pos.x, pos.y);
+	}
+	predicted_pos = glm::uvec2(pos.x, pos.y);
+	return predicted_pos;
+}
 
-			update_areas();
+void PlayMode::add_snapshot(Player *p, glm::vec2 pos) {
+	std::deque< Player::Snapshot > &snapshots = p->snapshots;
+	float tick = float(updates_received);
+	if (snapshots.empty()) {
+		p->draw_pos = pos;
+	} else {
+		Player::Snapshot const &last = snapshots.back();
+		p->velocity = (pos - last.pos) / std::max(tick - last.tick, 1.0f);
+		// (a move further than a speed powerup allows is a jump, not something to glide along)
+		if (glm::length(p->velocity) > 2.0f) p->velocity = glm::vec2(0.0f, 0.0f);
+	}
+	snapshots.emplace_back(Player::Snapshot{tick, pos});
+	while (snapshots.size() > MaxSnapshots) snapshots.pop_front();
+}
 
-			// check if player has won
-			if (territory_size > WIN_THRESHOLD) {
-				win_game(id, territory_size);
-			}
-		}
+void PlayMode::update_interpolation(float elapsed) {
+	if (updates_received == 0) return;
+
+	//the render clock runs at the estimated tick rate and is steered toward 'delay' behind the (estimated) current tick:
+	float delay = (interpolation_delay + std::min(2.0f * update_jitter, MaxJitterDelay)) / tick_interval;
+	float since_update = (last_update_at >= 0.0f ? (clock - last_update_at) / tick_interval : 0.0f);
+	float target = float(updates_received) + std::min(since_update, 1.0f) - delay;
+	render_tick += elapsed / tick_interval;
+	float error = target - render_tick;
+	if (std::abs(error) > 2.0f) {
+		// (way off, e.g. just started or after a stall -- jump there)
+		render_tick = target;
+	} else {
+		// (otherwise catch up over about half a second, so motion stays smooth)
+		render_tick += error * std::min(1.0f, elapsed / 0.5f);
 	}
-	// player hits other player's trail or territory
-	else if (tiles[x][y].color != base_color) {
-		// hit other player's territory:
-		if (std::find(player_colors.begin(), player_colors.end(), tiles[x][y].color) != player_colors.end()) {
-			// clear own trail
-			for (int col = 0; col < NUM_COLS; col++) {
-				for (int row = 0; row < NUM_ROWS; row++) {
-					if (tiles[col][row].color == trail_colors[id]) {
-						tiles[col][row].color = base_color;
-					}
-				}
-			}
+
+	for (auto &player : players) {
+		if (!player.active) continue;
+		std::deque< Player::Snapshot > &snapshots = player.snapshots;
+		if (player.id == local_id || snapshots.empty()) {
+			// (the local player is drawn where the prediction puts them)
+			player.draw_pos = glm::vec2(player.pos);
+			continue;
 		}
-		// hit other player's trail
-		else if (std::find(trail_colors.begin(), trail_colors.end(), tiles[x][y].color) != trail_colors.end()) {
-			// clear other player's trail
-			uint32_t other_player_trail_color = tiles[x][y].color;
-			for (int col = 0; col < NUM_COLS; col++) {
-				for (int row = 0; row < NUM_ROWS; row++) {
-					if (tiles[col][row].color == other_player_trail_color) {
-						tiles[col][row].color = base_color;
-					}
-				}
+		//keep only the newest snapshot at or before render_tick, and the ones after it:
+		while (snapshots.size() >= 2 && snapshots[1].tick <= render_tick) snapshots.pop_front();
+
+		Player::Snapshot const &a = snapshots[0];
+		if (render_tick <= a.tick) {
+			player.draw_pos = a.pos;
+		} else if (snapshots.size() >= 2) {
+			Player::Snapshot const &b = snapshots[1];
+			float t = (render_tick - a.tick) / (b.tick - a.tick);
+			if (glm::length(b.pos - a.pos) > 2.0f * (b.tick - a.tick)) {
+				player.draw_pos = (t < 0.5f ? a.pos : b.pos);
+			} else {
+				player.draw_pos = glm::mix(a.pos, b.pos, t);
 			}
-			// overwrite with our trail
-			tiles[x][y].color = trail_colors[id];
-			tiles[x][y].age = 0;
+		} else {
+			//updates are late, so keep going the way the player was going, for a little while:
+			player.draw_pos = a.pos + player.velocity * std::min(render_tick - a.tick, MaxExtrapolation);
 		}
 	}
-	else {
-		// update player's trail
-		tiles[x][y].color = trail_colors[id];
-		tiles[x][y].age = 0;
-	}
 }
 
 // TODO(candy): update this function so that max walk_frame = 3.0f
@@ -792,14 +946,14 @@ void PlayMode::draw_rectangle(glm::vec2 const &pos,
 
 void PlayMode::draw_borders(glm::u8vec4 const &color,
 							std::vector<Vertex> &vertices) {
-	for (int i = 0; i < NUM_ROWS+1; i++) {
+	for (int i = 0; i < board.rows+1; i++) {
 		draw_rectangle(glm::vec2(0.0f, i*TILE_SIZE-BORDER_SIZE/2.0f),
-					glm::vec2(GRID_W, BORDER_SIZE),
+					glm::vec2(grid_w(), BORDER_SIZE),
 					color, vertices);
 	}
-	for (int j = 0; j < NUM_COLS+1; j++) {
+	for (int j = 0; j < board.cols+1; j++) {
 		draw_rectangle(glm::vec2(j*TILE_SIZE-BORDER_SIZE/2.0f, 0.0f),
-					glm::vec2(BORDER_SIZE, GRID_H),
+					glm::vec2(BORDER_SIZE, grid_h()),
 					color, vertices);
 	}
 }
@@ -824,56 +978,62 @@ void PlayMode::draw_tiles(std::vector<Vertex> &vertices) {
 		return (uint32_t) (r3 << 24 | g3 << 16 | b3 << 8 | a3);
 	};
 
-	for (int x = 0; x < NUM_COLS; x++) {
-		for (int y = 0; y < NUM_ROWS; y++) {
-			std::vector<uint32_t>::const_iterator trail_it = std::find(trail_colors.begin(), trail_colors.end(), tiles[x][y].color);
-			bool is_trail_color = (trail_it != trail_colors.end());
+	for (int x = 0; x < board.cols; x++) {
+		for (int y = 0; y < board.rows; y++) {
+			GameSim::Tile const &tile = board.at(x, y);
+			bool is_trail = (tile.kind == GameSim::Tile::Trail);
 
-			if (tiles[x][y].color == base_color || is_trail_color) {
-				visual_board[x][y] = tiles[x][y].color;
+			if (tile.kind == GameSim::Tile::Empty || is_trail) {
+				visual_board[x][y] = tile_color(tile);
 			}
 			else {
-				visual_board[x][y] = lerp_color(visual_board[x][y], tiles[x][y].color, 0.1f);
+				visual_board[x][y] = lerp_color(visual_board[x][y], tile_color(tile), 0.1f);
 			}
 			glm::u8vec4 color = hex_to_color_vec(visual_board[x][y]);
 
-			if (is_trail_color) {
+			if (is_trail) {
 				// do not draw the first trail tile which overlaps with the player
-				uint8_t player_id = (uint8_t) (trail_it - trail_colors.begin());
-				Player player = players.at(player_id);
-				if (glm::uvec2(x, y) == player.pos) {
-					color = hex_to_color_vec(base_color);
+				// (nor the ones between there and a player drawn a little behind their latest position)
+				Player const *player = find_player(tile.owner);
+				if (player) {
+					glm::ivec2 from = glm::ivec2(glm::round(player->draw_pos));
+					glm::ivec2 to = glm::ivec2(player->pos);
+					glm::ivec2 at = glm::ivec2(x, y);
+					if ((at.x == from.x && at.x == to.x && std::min(from.y, to.y) <= at.y && at.y <= std::max(from.y, to.y))
+					 || (at.y == from.y && at.y == to.y && std::min(from.x, to.x) <= at.x && at.x <= std::max(from.x, to.x))) {
+						color = hex_to_color_vec(base_color);
+					}
 				}
 			} 
 			draw_rectangle(glm::vec2(x * TILE_SIZE, y * TILE_SIZE),
 					glm::vec2(TILE_SIZE, TILE_SIZE),
 					color,
 					vertices);
-			
-			// draw powerup
-			if (tiles[x][y].powerup.type != no_powerup) {
-				// color = hex_to_color_vec(black_color);
-				draw_texture(vertices, glm::vec2(x * TILE_SIZE, y * TILE_SIZE), 
-					glm::vec2(TILE_SIZE, TILE_SIZE),
-					glm::vec2((int)tiles[x][y].powerup.frame, 
-							tiles[x][y].powerup.type == speed ? 5.0f : 4.0f),
-					glm::vec2(1.0f, 1.0f),
-					glm::u8vec4(255, 255, 255, 255));
-				// std::cout << x << y << '\n';
-			} 
 		}
 	}
 
+	// draw powerup
+	if (powerup.type != no_powerup) {
+		draw_texture(vertices, glm::vec2(powerup_pos) * TILE_SIZE, 
+			glm::vec2(TILE_SIZE, TILE_SIZE),
+			glm::vec2((int)powerup.frame, 
+					powerup.type == speed ? 5.0f : 4.0f),
+			glm::vec2(1.0f, 1.0f),
+			glm::u8vec4(255, 255, 255, 255));
+	} 
+
 	// draw borders
-	draw_rectangle(glm::vec2(0, 0), glm::vec2(NUM_COLS, vertical_border) * TILE_SIZE, glm::u8vec4(0, 0, 0, 255), vertices);
-	draw_rectangle(glm::vec2(0, NUM_ROWS - vertical_border) * TILE_SIZE, glm::vec2(NUM_COLS, vertical_border) * TILE_SIZE, glm::u8vec4(0, 0, 0, 255), vertices);
-	draw_rectangle(glm::vec2(0, 0), glm::vec2(horizontal_border, NUM_ROWS) * TILE_SIZE, glm::u8vec4(0, 0, 0, 255), vertices);
-	draw_rectangle(glm::vec2(NUM_COLS - horizontal_border, 0) * TILE_SIZE, glm::vec2(horizontal_border, NUM_ROWS) * TILE_SIZE, glm::u8vec4(0, 0, 0, 255), vertices);
+	uint16_t horizontal_border = board.horizontal_border;
+	uint16_t vertical_border = board.vertical_border;
+	draw_rectangle(glm::vec2(0, 0), glm::vec2(board.cols, vertical_border) * TILE_SIZE, glm::u8vec4(0, 0, 0, 255), vertices);
+	draw_rectangle(glm::vec2(0, board.rows - vertical_border) * TILE_SIZE, glm::vec2(board.cols, vertical_border) * TILE_SIZE, glm::u8vec4(0, 0, 0, 255), vertices);
+	draw_rectangle(glm::vec2(0, 0), glm::vec2(horizontal_border, board.rows) * TILE_SIZE, glm::u8vec4(0, 0, 0, 255), vertices);
+	draw_rectangle(glm::vec2(board.cols - horizontal_border, 0) * TILE_SIZE, glm::vec2(horizontal_border, board.rows) * TILE_SIZE, glm::u8vec4(0, 0, 0, 255), vertices);
 }
 
 void PlayMode::draw_players(std::vector<Vertex>& vertices) {
-	for (auto& [id, player] : players) {
-		(void) id; // appease compiler's unused variable warning
+	for (auto& player : players) {
+		if (!player.active) continue;
 		// draw player
 		// std::cout << "id: " + std::to_string(player.id) << " dir: " + std::to_string(player.dir) << std::endl;
 		glm::vec2 tex_pos;
@@ -898,13 +1058,15 @@ void PlayMode::draw_players(std::vector<Vertex>& vertices) {
 				tex_pos.y = 3.0f;
 				break;
 		}
-		tex_pos.x = player.id*3.0f + (int)player.walk_frame;
+		// (players past the ones with their own sprites reuse one, tinted with their color)
+		tex_pos.x = (player.id % SPRITE_PLAYERS)*3.0f + (int)player.walk_frame;
+		glm::u8vec4 tint = (player.id < SPRITE_PLAYERS ? glm::u8vec4(255, 255, 255, 255) : hex_to_color_vec(player.color));
 
-		draw_texture(vertices, glm::vec2(player.pos.x * TILE_SIZE, player.pos.y * TILE_SIZE), 
+		draw_texture(vertices, player.draw_pos * TILE_SIZE,
 					glm::vec2(TILE_SIZE, TILE_SIZE),
 					tex_pos,
 					glm::vec2(1.0f, 1.0f),
-					glm::u8vec4(255, 255, 255, 255));
+					tint);
 		// draw_rectangle(glm::vec2(player.pos.x * TILE_SIZE, player.pos.y * TILE_SIZE),
 		// 	glm::vec2(TILE_SIZE, TILE_SIZE),
 		// 	hex_to_color_vec(player.color),
@@ -913,16 +1075,6 @@ void PlayMode::draw_players(std::vector<Vertex>& vertices) {
 		// 	glm::vec2(TILE_SIZE / 2, TILE_SIZE / 2),
 		// 	hex_to_color_vec(white_color),
 		// 	vertices);
-		#ifdef DEBUG_TRAIL
-			draw_rectangle(glm::vec2(player.prev_pos[0].x * TILE_SIZE, player.prev_pos[0].y * TILE_SIZE),
-				glm::vec2(TILE_SIZE, TILE_SIZE),
-				hex_to_color_vec(0xff0000ff),
-				vertices);
-			draw_rectangle(glm::vec2(player.prev_pos[1].x * TILE_SIZE, player.prev_pos[1].y * TILE_SIZE),
-				glm::vec2(TILE_SIZE, TILE_SIZE),
-				hex_to_color_vec(0x00ff00ff),
-				vertices);
-		#endif
 	}
 }
 
@@ -941,7 +1093,7 @@ void PlayMode::draw_texture(std::vector< Vertex >& vertices, glm::vec2 pos, glm:
 
 void PlayMode::draw_splash(std::vector< Vertex >& vertices) {
 	// std::cout << "tilepos: " + glm::to_string(tilepos) + ", tilesize: " + glm::to_string(tilesize) << std::endl;
-	glm::vec2 pos = glm::vec2(0.0f, 0.0f);//glm::vec2(0.5f * GRID_W, 0.5f * GRID_H) - 0.5f * splash_screen_size;
+	glm::vec2 pos = glm::vec2(0.0f, 0.0f);//glm::vec2(0.5f * grid_w(), 0.5f * grid_h()) - 0.5f * splash_screen_size;
 	glm::u8vec4 color = glm::u8vec4(255, 255, 255, 255);
 
 	vertices.emplace_back(glm::vec3(pos.x, pos.y, 0.0f), color, glm::vec2(0.0f, 0.0f));
@@ -976,44 +1128,19 @@ void PlayMode::draw_text(std::vector< Vertex >& vertices, std::string msg, glm::
 	draw_string(msg, glm::vec2(anchor.x - 0.5f * width, anchor.y + 0.5f * 13.0f), color);
 }
 
-glm::uvec2 PlayMode::get_new_powerup_location() {
-	std::vector<glm::uvec2> empty_pos;
-	for (int x = horizontal_border; x < NUM_COLS - 1 - horizontal_border; x++) {
-		for (int y = vertical_border; y < NUM_ROWS - 1 - vertical_border; y++) {
-			if (tiles[x][y].color == base_color) {
-				empty_pos.push_back(glm::uvec2(x, y));
-			}
-		}
-	}
-	return empty_pos[rand() % empty_pos.size()];
-}
-
 void PlayMode::new_powerup(PowerupType type, glm::uvec2 location) {
-	// clear old powerup
-	for (int x = horizontal_border; x < NUM_COLS - 1 - horizontal_border; x++) {
-		for (int y = vertical_border; y < NUM_ROWS - 1 - vertical_border; y++) {
-			tiles[x][y].powerup.type = no_powerup;
-		}
-	}
-	for (auto& [id, player] : players) {
-		(void) id;
-		player.powerup_type = no_powerup;
-	}
-
-	tiles[location.x][location.y].powerup.type = type;
-	tiles[location.x][location.y].powerup.frame = 0.0f;
+	// (replaces the old powerup; no_powerup means it was picked up)
+	powerup.type = type;
+	powerup.frame = 0.0f;
+	powerup_pos = location;
 }
 
 void PlayMode::update_powerup(float elapsed) {
-	for (int x = horizontal_border; x < NUM_COLS - 1 - horizontal_border; x++) {
-		for (int y = vertical_border; y < NUM_ROWS - 1 - vertical_border; y++) {
-			if (tiles[x][y].powerup.type == no_powerup) continue;
-			float num_frames = tiles[x][y].powerup.type == speed ? 4.0f : 5.0f; 
-			float next_frame = tiles[x][y].powerup.frame + num_frames * elapsed / 0.5f;
-			while (next_frame > num_frames) { next_frame -= num_frames;}
-			tiles[x][y].powerup.frame = next_frame; 
-		}
-	}
+	if (powerup.type == no_powerup) return;
+	float num_frames = powerup.type == speed ? 4.0f : 5.0f; 
+	float next_frame = powerup.frame + num_frames * elapsed / 0.5f;
+	while (next_frame > num_frames) { next_frame -= num_frames;}
+	powerup.frame = next_frame; 
 }
 
 void PlayMode::win_game(uint8_t id, uint32_t area) {
@@ -1021,159 +1148,3 @@ void PlayMode::win_game(uint8_t id, uint32_t area) {
 	winner_id = id;
 	winner_score = area;
 }
-
-// shortest path using Dijkstra's algorithm (returns empty vector if no path exists)
-std::vector< glm::uvec2 > PlayMode::shortest_path(glm::uvec2 const &start, glm::uvec2 const &end, std::vector< glm::uvec2 > const &allowed_tiles) {
-	struct DijkstraPoint {
-		uint32_t distance;
-		glm::uvec2 pos;
-		DijkstraPoint(unsigned int const &_distance, glm::uvec2 const &_pos): distance(_distance), pos(_pos) {}
-	};
-
-	struct CompareDijkstraPoint {
-		bool operator()(DijkstraPoint const &p1, DijkstraPoint const &p2) {
-			return p1.distance > p2.distance;
-		}
-	};
-
-	std::priority_queue<DijkstraPoint, std::vector<DijkstraPoint>, CompareDijkstraPoint> pqueue;
-
-	std::unordered_map<glm::uvec2, uint32_t> dist;
-	std::unordered_map<glm::uvec2, glm::uvec2> prev;
-
-	// populate priority queue
-	dist[start] = 0;
-	pqueue.push(DijkstraPoint(0, start));
-	for (glm::uvec2 pos : allowed_tiles) {
-		if (start == pos) {
-			continue;
-		}
-		dist[pos] = (NUM_ROWS + NUM_COLS) * 100; // "infinity" (no distance will ever be this high)
-		pqueue.push(DijkstraPoint(dist[pos], pos));
-	}
-
-	// neighbor helper function
-	auto neighbors = [&](glm::uvec2 p) {
-		std::vector<glm::uvec2> neighbors;
-		if (p.x + 1 < NUM_COLS && 
-			std::find(allowed_tiles.begin(), allowed_tiles.end(), glm::uvec2(p.x+1, p.y)) != allowed_tiles.end())
-			neighbors.push_back(glm::uvec2(p.x + 1, p.y));
-		if (p.x - 1 >= 0 && 
-			std::find(allowed_tiles.begin(), allowed_tiles.end(), glm::uvec2(p.x-1, p.y)) != allowed_tiles.end())
-			neighbors.push_back(glm::uvec2(p.x - 1, p.y));
-		if (p.y + 1 < NUM_ROWS &&
-			std::find(allowed_tiles.begin(), allowed_tiles.end(), glm::uvec2(p.x, p.y+1)) != allowed_tiles.end())
-			neighbors.push_back(glm::uvec2(p.x, p.y + 1));
-		if (p.y - 1 >= 0 && 
-			std::find(allowed_tiles.begin(), allowed_tiles.end(), glm::uvec2(p.x, p.y-1)) != allowed_tiles.end())
-			neighbors.push_back(glm::uvec2(p.x, p.y - 1));
-		return neighbors;
-	};
-
-	// do dijkstra's algorithm
-	while (!pqueue.empty()) {
-		DijkstraPoint const p = pqueue.top();
-		pqueue.pop();
-
-		for (auto const &neighbor : neighbors(p.pos)) {
-			uint32_t alt = dist.at(p.pos) + 1;
-			if (alt < dist.at(neighbor)) {
-				dist[neighbor] = alt;
-				prev[neighbor] = p.pos;
-				// std::cout << neighbor.x << ", " << neighbor.y << " -> " << p.pos.x << ", " << p.pos.y << std::endl;
-				pqueue.push(DijkstraPoint(dist.at(neighbor), neighbor));
-			}
-		}
-	}
-
-	// std::cout << "start " << start.x << ", " << start.y << std::endl;
-	// std::cout << "end " << end.x << ", " << end.y << std::endl;
-
-	std::vector<glm::uvec2> shortest_path;
-	glm::uvec2 pos = end;
-	while (pos != start) {
-		shortest_path.push_back(pos);
-		// std::cout << pos.x << ", " << pos.y << std::endl;
-		if (prev.find(pos) == prev.end()) { // no path exists
-			shortest_path.clear();
-			return shortest_path;
-		}
-		pos = prev.at(pos);
-	}
-	shortest_path.push_back(start);
-
-	return shortest_path;
-}
-
-void PlayMode::floodfill(std::vector<std::vector<uint32_t>> &grid, uint32_t x, uint32_t y, uint32_t new_color, uint32_t old_color) {
-	if (new_color == old_color) return;
-	if (x < 0 || y < 0 || x >= grid.size() || y >= grid[0].size()) return;
-	if (grid[x][y] == old_color) {
-		grid[x][y] = new_color;
-
-		floodfill(grid, x + 1, y, new_color, old_color);
-		floodfill(grid, x - 1, y, new_color, old_color);
-		floodfill(grid, x, y + 1, new_color, old_color);
-		floodfill(grid, x, y - 1, new_color, old_color);
-	}
-};
-
-// fills all regions enclosed by a player's color, returns new size of territory
-void PlayMode::fill_interior(uint32_t color, uint32_t &delta_size, uint32_t &territory_size) {
-	const uint32_t EMPTY = 0;
-	const uint32_t BORDER = 1;
-	const uint32_t FILL = 2;
-
-	territory_size = 0;
-	delta_size = 0;
-
-	// create grid, adding a 1 tile border on all sides
-	std::vector<std::vector<uint32_t>> tiles_copy;
-	for (int x = -1; x < NUM_COLS + 1; x++) {
-		std::vector<uint32_t> tile_col;
-		for (int y = -1; y < NUM_ROWS + 1; y++) {
-			if (y == -1 || y == NUM_ROWS || x == -1 || x == NUM_COLS || tiles[x][y].color != color)
-				tile_col.push_back(EMPTY);
-			else {
-				// tile is in bounds and is the fill player's color
-				tile_col.push_back(BORDER);
-				territory_size++;
-			}
-		}
-		tiles_copy.push_back(tile_col);
-	}
-
-	// floodfill outer area, starting from border (top-left)
-	floodfill(tiles_copy, 0, 0, FILL, EMPTY);
-
-	// set all non-filled/interior tiles to color
-	for (int x = 0; x < NUM_COLS + 2; x++) {
-		for (int y = 0; y < NUM_ROWS + 2; y++) {
-			if (tiles_copy[x][y] == EMPTY && x - 1 >= 0 && y - 1 >= 0 && x - 1 < NUM_COLS && y - 1 < NUM_ROWS) {
-				tiles[x-1][y-1].color = color;
-				territory_size++;
-				delta_size++;
-				// std::cout << "(" << x << ", " << y << ")" << std::endl;
-			}
-		}
-	}
-	return;
-}
-
-void PlayMode::update_areas() {
-	for (auto &[id, player] : players) {
-		(void) id;
-		player.area = 0;
-	}
-	for (int x = 0; x < NUM_COLS; x++) {
-		for (int y = 0; y < NUM_ROWS; y++) {
-			if (tiles[x][y].color != white_color) {
-				for (uint32_t i = 0; i < player_colors.size(); i++) {
-					if (tiles[x][y].color == player_colors[i]) {
-						players.at(i).area++;
-					}
-				}
-			}
-		}
-	}
-}
\ No newline at end of file
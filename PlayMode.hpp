@@ -2,18 +2,18 @@
 
 #include "Connection.hpp"
 #include "Sound.hpp"
+#include "GameSim.hpp"
 
 #include <glm/glm.hpp>
 #include <glm/gtx/hash.hpp>
 #include "GL.hpp"
 
+#include <array>
 #include <vector>
 #include <deque>
 #include <unordered_map>
 #include <set>
 
-//#define DEBUG_TRAIL
-
 struct PlayMode : Mode
 {
 	PlayMode(Client &client);
@@ -25,19 +25,16 @@ struct PlayMode : Mode
 	virtual void draw(glm::uvec2 const &drawable_size) override;
 
 	//----- constants ------
-	const uint8_t NUM_ROWS = 20;
-	const uint8_t NUM_COLS = 40;
 	const float TILE_SIZE = 20.0f;
 	const float BORDER_SIZE = 0.1f * TILE_SIZE;
-	const uint8_t TRAIL_MAX_LEN = 50;
-	const uint8_t TRAIL_POWERUP_LEN = 20;
-	const uint32_t WIN_THRESHOLD = NUM_ROWS * NUM_COLS / 2;
 
-	const float GRID_W = NUM_COLS * TILE_SIZE;
-	const float GRID_H = NUM_ROWS * TILE_SIZE;
+	//(the board's size is set by the server for each game)
+	float grid_w() const { return board.cols * TILE_SIZE; }
+	float grid_h() const { return board.rows * TILE_SIZE; }
 	const float PADDING = 50.0f;
 	const glm::uvec2 WINDOW_SIZE = glm::uvec2(1280, 720);
 
+	// (same values as GameSim's, which is what goes over the wire)
 	enum PowerupType { speed, trail, no_powerup };
 	// ll, rr, uu, dd are for player with speed powerup
 	enum Dir { left, right, up, down, ll, rr, uu, dd, none };
@@ -51,13 +48,17 @@ struct PlayMode : Mode
 	const uint32_t border_color = 0xd5cdd8ff;
 	const std::unordered_map<PowerupType, uint32_t> powerup_colors{{speed, 0xcb5ab2ff},
 																	{trail, 0x88c7ffff}};
-	const std::vector<uint32_t> player_colors{0x390099ff, 0xffbd00ff, 0xff5400ff, 0x9e0059ff};
-	const std::vector<uint32_t> trail_colors{0x8762c5ff,  0xffdf83ff, 0xffa980ff, 0xca679fff};
+	// indexed by player id; the first four are hand-picked, the rest generated (see init_palette):
+	std::vector<uint32_t> player_colors{0x390099ff, 0xffbd00ff, 0xff5400ff, 0x9e0059ff};
+	std::vector<uint32_t> trail_colors{0x8762c5ff,  0xffdf83ff, 0xffa980ff, 0xca679fff};
+	const uint32_t SPRITE_PLAYERS = 4; // players with their own sprites (the rest reuse them, tinted)
 
 	//----- game state -----
-	enum GameState { MAIN_MENU, QUEUEING, IN_GAME };
+	enum GameState { MAIN_MENU, QUEUEING, IN_GAME, SPECTATING };
 	GameState gameState = MAIN_MENU;
 	uint8_t lobby_size = 0;
+	uint8_t lobby_target = 2; // players needed to start a game
+	uint32_t spectated_game = 0; // server's id of the game being watched (0 = none running)
 
 	bool GAME_OVER = false;
 	uint8_t winner_id;
@@ -69,36 +70,69 @@ struct PlayMode : Mode
 		float frame = 0.0f;
 	};
 
-	struct Tile
-	{
-		Tile(uint32_t _color, uint8_t _age) : color(_color), age(_age) { }
-		uint32_t color;
-		uint8_t age; // for trail tiles
-		Powerup powerup = Powerup(no_powerup);
-	};
+	Powerup powerup = Powerup(no_powerup);
+	glm::uvec2 powerup_pos = glm::uvec2(0, 0);
 
-	std::vector<std::vector<Tile>> tiles; // logical representation of game state
+	GameSim board; // logical representation of game state (as sent by the server)
 	std::vector<std::vector<uint32_t>> visual_board; // visual representation of game state
-	uint8_t horizontal_border, vertical_border; // "walls"
 	uint8_t start_countdown = 0;
 
 	struct Player
 	{
-		Player(uint8_t _id, uint32_t _color, glm::uvec2 _pos) : id(_id), color(_color), pos(_pos) {}
-		uint8_t id;
-		uint32_t color;
+		bool active = false; // (entries for ids that aren't in the game stay inactive)
+		uint8_t id = 0;
+		uint32_t color = 0;
 		uint32_t area = 0;
-		glm::uvec2 pos;
-		glm::uvec2 prev_pos[2]; // previous 2 positions (for calculating loops)
+		glm::uvec2 pos = glm::uvec2(0, 0);
+		glm::vec2 draw_pos = glm::vec2(0.0f, 0.0f); // where the sprite is drawn (see update_interpolation)
+		struct Snapshot {
+			float tick; // updates_received when it arrived
+			glm::vec2 pos;
+		};
+		std::deque< Snapshot > snapshots; // the server's recent positions for this player, oldest first
+		glm::vec2 velocity = glm::vec2(0.0f, 0.0f); // tiles per tick between the last two snapshots (for extrapolating)
 		PowerupType powerup_type = no_powerup;
 		Dir dir = none; // current facing direction for sprite rendering
-		// prev_pos[0] = position 1 new position ago
-		// prev_pos[1] = position 2 new positions ago
 		std::shared_ptr< Sound::PlayingSample > walk_sound = nullptr;
 		float walk_frame = 1.0f;
 	};
-	std::unordered_map<uint8_t, Player> players;
+	std::vector< Player > players; // indexed by id
+	Player *find_player(uint8_t id) { return (id < players.size() && players[id].active ? &players[id] : nullptr); }
 	uint8_t local_id; // player corresponding to this connection
+	const uint8_t SPECTATOR_ID = 0xff; // local_id while spectating (matches no player)
+
+	//----- local player prediction -----
+	//inputs go to the server once per (estimated) server tick, and the local player is moved right away with the
+	// server's movement rules; the server queues them and applies one per tick, and says ('y') how many each update
+	// reflects, so each update can re-run the inputs it hasn't applied yet from the server's position if the
+	// prediction turned out wrong:
+	struct PredictedInput {
+		Dir dir = none;
+		bool stepped = false; // (inputs sent during the start countdown don't move)
+		glm::uvec2 pos = glm::uvec2(0, 0); // predicted position after this input's tick
+	};
+	static constexpr uint16_t PredictionCapacity = 64; // (a power of two, so input counts can wrap)
+	std::array< PredictedInput, PredictionCapacity > predictions; // input number n is predictions[n % PredictionCapacity]
+	uint16_t inputs_sent = 0; // 'b' messages sent this game (wraps, like the server's count)
+	uint16_t inputs_acked = 0; // inputs the latest update reflects (from 'y')
+	uint8_t inputs_queued = 1; // inputs waiting in the server's queue (from 'y'; inputs are paced to keep about one there)
+	glm::uvec2 predicted_pos = glm::uvec2(0, 0);
+	float tick_interval = 0.1f; // server tick period, estimated from when updates arrive
+	float tick_timer = 0.0f; // time until the next input is due
+	float clock = 0.0f; // time since startup (for timing updates)
+	float last_update_at = -1.0f; // clock when the last update arrived (negative if none yet this game)
+
+	//----- remote player interpolation -----
+	//other players are drawn a little in the past, between the two buffered snapshots around 'render_tick', so they
+	// glide from tile to tile instead of jumping once per server tick; the delay grows with the jitter in when
+	// updates arrive, and if updates are late anyway players keep going (briefly) the way they were going:
+	float interpolation_delay = 0.1f; // seconds behind the newest update, before jitter (client's optional third argument, in ms)
+	static constexpr float MaxJitterDelay = 0.25f; // most extra delay added for jitter, in seconds
+	static constexpr float MaxExtrapolation = 0.5f; // ticks to keep moving past the newest snapshot
+	static constexpr size_t MaxSnapshots = 32; // (per player)
+	uint32_t updates_received = 0; // 'a' messages since the board was reset (snapshot time is counted in these)
+	float render_tick = 0.0f; // the time players are drawn at
+	float update_jitter = 0.0f; // average difference between update intervals and tick_interval, in seconds
 
 	//connection to server:
 	Client &client;
@@ -127,9 +161,19 @@ struct PlayMode : Mode
 	glm::u8vec4 hex_to_color_vec(int color_hex);
 	void reset_state();
 	void init_tiles();
+	void init_palette();
+	void resize_board(uint16_t cols, uint16_t rows);
+
+	uint32_t tile_color(GameSim::Tile const &tile);
 
 	void create_player(uint8_t id, Dir dir, glm::uvec2 pos);
-	void update_player(Player *p, Dir dir, glm::uvec2 pos, float elapsed);
+	void update_player(Player *p, Dir dir, glm::uvec2 pos, bool moving, PowerupType powerup_type, uint32_t area, float elapsed);
+
+	void reset_prediction();
+	void predict_tick(Dir dir); // send the input for the next tick and move the local player
+	glm::uvec2 reconcile(glm::uvec2 server_pos); // returns where to show the local player, given the server's position
+	void add_snapshot(Player *p, glm::vec2 pos);
+	void update_interpolation(float elapsed); // move render_tick along and set every player's draw_pos
 	void update_sound(Player* p, bool moving, float elapsed);
 
 	void draw_rectangle(glm::vec2 const &pos,
@@ -145,13 +189,8 @@ struct PlayMode : Mode
 	void draw_texture(std::vector< Vertex >& vertices, glm::vec2 pos, glm::vec2 size, glm::vec2 tilepos, glm::vec2 tilesize, glm::u8vec4 color);
 	void draw_text(std::vector< Vertex >& vertices, std::string msg, glm::vec2 anchor, glm::u8vec4 color);
 
-	glm::uvec2 get_new_powerup_location();
 	void new_powerup(PowerupType type, glm::uvec2 location);
 	void update_powerup(float elapsed);
 
 	void win_game(uint8_t id, uint32_t area);
-	std::vector<glm::uvec2> shortest_path(glm::uvec2 const &start, glm::uvec2 const &end, std::vector<glm::uvec2> const &allowed_tiles);
-	void floodfill(std::vector<std::vector<uint32_t>> &grid, uint32_t x, uint32_t y, uint32_t new_color, uint32_t old_color);
-	void fill_interior(uint32_t color, uint32_t &delta_size, uint32_t &total_size);
-	void update_areas();
 };
@@ -0,0 +1,50 @@
+#pragma once
+
+//Small, fast, seedable random number generator (PCG32, XSH-RR variant).
+// see: https://www.pcg-random.org/
+//
+//Unlike rand(), each Rng carries its own state, so (e.g.) every game can
+// have its own generator and be re-run exactly from its seed.
+//
+//Also satisfies UniformRandomBitGenerator, so it works with <random> distributions.
+
+#include <cstdint>
+#include <limits>
+
+struct Rng {
+	typedef uint32_t result_type;
+
+	explicit Rng(uint64_t seed_ = 0x853c49e6748fea9bULL) { seed(seed_); }
+
+	void seed(uint64_t seed_) {
+		state = 0;
+		(*this)();
+		state += seed_;
+		(*this)();
+	}
+
+	//next 32 random bits:
+	uint32_t operator()() {
+		uint64_t old = state;
+		state = old * 6364136223846793005ULL + Increment;
+		uint32_t xorshifted = uint32_t(((old >> 18u) ^ old) >> 27u);
+		uint32_t rot = uint32_t(old >> 59u);
+		return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+	}
+
+	//uniformly distributed value in [0, bound) (bound must be > 0):
+	uint32_t below(uint32_t bound) {
+		//rejection sampling to avoid modulo bias:
+		uint32_t threshold = (-bound) % bound;
+		while (true) {
+			uint32_t r = (*this)();
+			if (r >= threshold) return r % bound;
+		}
+	}
+
+	static constexpr uint32_t min() { return 0; }
+	static constexpr uint32_t max() { return std::numeric_limits< uint32_t >::max(); }
+
+	static constexpr uint64_t Increment = 1442695040888963407ULL;
+	uint64_t state = 0;
+};
@@ -0,0 +1,93 @@
+#include "TickScheduler.hpp"
+
+#include <thread>
+#include <stdexcept>
+#include <algorithm>
+#include <cmath>
+
+TickScheduler::TickScheduler(double tick_rate) {
+	set_tick_rate(tick_rate);
+	next_tick = Clock::now() + std::chrono::duration_cast< Clock::duration >(period);
+}
+
+void TickScheduler::set_tick_rate(double tick_rate) {
+	if (!(tick_rate > 0.0 && tick_rate <= 1000.0)) {
+		throw std::runtime_error("Tick rate of " + std::to_string(tick_rate) + " is not in (0,1000] ticks per second.");
+	}
+	period = std::chrono::duration< double >(1.0 / tick_rate);
+}
+
+double TickScheduler::time_until_tick() const {
+	double remain = std::chrono::duration< double >(next_tick - Clock::now()).count();
+	return std::max(0.0, remain);
+}
+
+void TickScheduler::wait_for_tick() const {
+	std::this_thread::sleep_until(next_tick);
+}
+
+void TickScheduler::begin_tick() {
+	tick_start = Clock::now();
+	auto step = std::chrono::duration_cast< Clock::duration >(period);
+
+	if (tick_start - next_tick >= step) {
+		late_ticks += 1;
+	}
+
+	//advance the deadline by exactly one period (so lateness doesn't accumulate)...
+	next_tick += step;
+	//...unless that would leave too many ticks to run back-to-back, in which case skip them:
+	if (tick_start - next_tick > MaxCatchUpTicks * step) {
+		uint64_t behind = uint64_t((tick_start - next_tick) / step);
+		skipped_ticks += behind;
+		next_tick += behind * step;
+	}
+}
+
+void TickScheduler::end_tick() {
+	uint64_t us = uint64_t(std::chrono::duration_cast< std::chrono::microseconds >(Clock::now() - tick_start).count());
+
+	last_work_us = us;
+	ticks += 1;
+	if (std::chrono::duration< double >(us * 1e-6) > period) {
+		overrun_ticks += 1;
+	}
+	work_max_us = std::max(work_max_us, us);
+
+	uint32_t bucket = 0;
+	while (us > 0 && bucket + 1 < work_histogram.size()) {
+		us >>= 1;
+		bucket += 1;
+	}
+	work_histogram[bucket] += 1;
+}
+
+uint64_t TickScheduler::work_percentile_us(double percentile) const {
+	uint64_t total = 0;
+	for (auto count : work_histogram) total += count;
+	if (total == 0) return 0;
+
+	uint64_t target = uint64_t(std::ceil(percentile * total));
+	uint64_t seen = 0;
+	for (uint32_t i = 0; i < work_histogram.size(); ++i) {
+		seen += work_histogram[i];
+		if (seen >= target) return (uint64_t(1) << i);
+	}
+	return work_max_us;
+}
+
+std::string TickScheduler::stats_summary() const {
+	return std::to_string(ticks) + " ticks @ " + std::to_string(int(std::round(tick_rate()))) + "Hz"
+		+ ", work p50 <" + std::to_string(work_percentile_us(0.5)) + "us"
+		+ " p99 <" + std::to_string(work_percentile_us(0.99)) + "us"
+		+ " max " + std::to_string(work_max_us) + "us"
+		+ ", " + std::to_string(overrun_ticks) + " overrun"
+		+ ", " + std::to_string(late_ticks) + " late"
+		+ ", " + std::to_string(skipped_ticks) + " skipped";
+}
+
+void TickScheduler::clear_stats() {
+	ticks = late_ticks = overrun_ticks = skipped_ticks = 0;
+	work_histogram.fill(0);
+	work_max_us = 0;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+/*
+ * TickScheduler keeps the server's fixed-rate simulation ticks on a
+ * drift-free schedule and keeps statistics about how long ticks take.
+ *
+ * Deadlines are absolute (tick N is due at start + N * period), so a late
+ * tick doesn't shift every later tick. If the server falls more than
+ * MaxCatchUpTicks behind, the missed ticks are skipped (and counted)
+ * instead of being run back-to-back.
+ *
+ * Usage:
+
+	TickScheduler scheduler(10.0); //10 ticks per second
+	while (true) {
+		//wait for network traffic until the tick is due:
+		while (!scheduler.tick_due()) {
+			double remain = scheduler.time_until_tick();
+			if (remain < TickScheduler::MinPollWait) {
+				scheduler.wait_for_tick(); //too close to bother with select()
+			} else {
+				server.poll(..., remain);
+			}
+		}
+		scheduler.begin_tick();
+		//... update game state ...
+		scheduler.end_tick();
+	}
+
+ */
+
+#include <chrono>
+#include <array>
+#include <cstdint>
+#include <string>
+
+struct TickScheduler {
+	typedef std::chrono::steady_clock Clock;
+
+	TickScheduler(double tick_rate); //ticks per second
+
+	//change tick rate (takes effect from the next tick on):
+	void set_tick_rate(double tick_rate);
+	double tick_rate() const { return 1.0 / period.count(); }
+
+	//seconds until the next tick is due (never negative):
+	double time_until_tick() const;
+	bool tick_due() const { return Clock::now() >= next_tick; }
+
+	//sleep until the next tick is due:
+	void wait_for_tick() const;
+
+	//waits shorter than this (seconds) are done with wait_for_tick() rather than by polling sockets:
+	static constexpr double MinPollWait = 0.001;
+	//how many missed ticks will be run late before the rest are skipped:
+	static constexpr uint32_t MaxCatchUpTicks = 3;
+
+	//bracket the work done for each tick:
+	void begin_tick();
+	void end_tick();
+
+	//---- statistics ----
+	uint64_t ticks = 0; //ticks run
+	uint64_t late_ticks = 0; //ticks that started more than a full period after their deadline
+	uint64_t overrun_ticks = 0; //ticks whose work took longer than a period
+	uint64_t skipped_ticks = 0; //ticks dropped to catch up to the schedule
+
+	//histogram of per-tick work time; bucket i counts ticks taking [2^(i-1), 2^i) microseconds:
+	std::array< uint64_t, 24 > work_histogram{};
+	uint64_t work_max_us = 0;
+	uint64_t last_work_us = 0; //work time of the most recent tick
+
+	//approximate percentile (0-1) of tick work time, in microseconds (upper edge of bucket):
+	uint64_t work_percentile_us(double percentile) const;
+	//one-line summary of the statistics:
+	std::string stats_summary() const;
+	//reset statistics (e.g. after reporting them):
+	void clear_stats();
+
+	//internals:
+	std::chrono::duration< double > period;
+	Clock::time_point next_tick;
+	Clock::time_point tick_start;
+};
@@ -0,0 +1,121 @@
+#include "TimerWheel.hpp"
+
+#include <cassert>
+
+TimerWheel::TimerWheel() {
+	for (auto &level : wheel) {
+		level.fill(None);
+	}
+}
+
+TimerWheel::Handle TimerWheel::schedule(uint32_t delay, uint32_t period, std::function< void() > const &fn) {
+	assert(delay >= 1 && "timers fire on a later tick");
+
+	uint32_t index;
+	if (!free_timers.empty()) {
+		index = free_timers.back();
+		free_timers.pop_back();
+	} else {
+		index = uint32_t(timers.size());
+		timers.emplace_back();
+	}
+
+	Timer &timer = timers[index];
+	timer.expires = now + delay;
+	timer.period = period;
+	timer.fn = fn;
+	insert(index);
+	pending += 1;
+
+	return (Handle(timer.generation) << 32) | index;
+}
+
+void TimerWheel::cancel(Handle handle) {
+	if (handle == NoTimer) return;
+	uint32_t index = uint32_t(handle);
+	if (index >= timers.size()) return;
+	Timer &timer = timers[index];
+	if (timer.generation != uint32_t(handle >> 32) || timer.list == nullptr) return;
+
+	unlink(index);
+	release(index);
+}
+
+void TimerWheel::advance() {
+	now += 1;
+
+	//when a level's position wraps around, bring the timers in the next level's current slot down:
+	for (uint32_t level = 1; level < Levels; ++level) {
+		if ((now >> (LevelBits * (level - 1))) % Slots != 0) break;
+		uint32_t &slot = wheel[level][(now >> (LevelBits * level)) % Slots];
+		while (slot != None) {
+			uint32_t index = slot;
+			unlink(index);
+			insert(index);
+		}
+	}
+
+	//move the due slot to 'firing' so callbacks can safely cancel anything in it:
+	uint32_t &due = wheel[0][now % Slots];
+	while (due != None) {
+		uint32_t index = due;
+		unlink(index);
+		link(index, &firing);
+	}
+
+	while (firing != None) {
+		uint32_t index = firing;
+		unlink(index);
+		assert(timers[index].expires == now);
+
+		//copy the callback, since it may schedule timers (and so reallocate 'timers'):
+		std::function< void() > fn = timers[index].fn;
+		if (timers[index].period != 0) {
+			timers[index].expires = now + timers[index].period;
+			insert(index);
+		} else {
+			release(index);
+		}
+		fired += 1;
+		fn();
+	}
+}
+
+void TimerWheel::link(uint32_t index, uint32_t *list) {
+	Timer &timer = timers[index];
+	timer.list = list;
+	timer.prev = None;
+	timer.next = *list;
+	if (*list != None) timers[*list].prev = index;
+	*list = index;
+}
+
+void TimerWheel::unlink(uint32_t index) {
+	Timer &timer = timers[index];
+	assert(timer.list);
+	if (timer.prev != None) timers[timer.prev].next = timer.next;
+	else *timer.list = timer.next;
+	if (timer.next != None) timers[timer.next].prev = timer.prev;
+	timer.prev = timer.next = None;
+	timer.list = nullptr;
+}
+
+void TimerWheel::insert(uint32_t index) {
+	uint64_t expires = timers[index].expires;
+	assert(expires >= now); //(equal only while cascading, in which case it lands in the slot about to fire)
+	uint64_t delta = expires - now;
+
+	uint32_t level = 0;
+	while (level + 1 < Levels && delta >= (uint64_t(1) << (LevelBits * (level + 1)))) {
+		level += 1;
+	}
+	link(index, &wheel[level][(expires >> (LevelBits * level)) % Slots]);
+}
+
+void TimerWheel::release(uint32_t index) {
+	Timer &timer = timers[index];
+	timer.generation += 1;
+	timer.fn = nullptr;
+	free_timers.emplace_back(index);
+	pending -= 1;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+/*
+ * TimerWheel is a hierarchical timing wheel for events scheduled in whole
+ * ticks. Scheduling and cancelling are O(1), and advance() only touches
+ * the timers that are due (plus an occasional cascade of timers moving
+ * down from a coarser level), so a tick costs about the same no matter
+ * how many far-off timers are waiting.
+ *
+ * Four levels of 256 slots cover delays up to 2^32 ticks.
+ *
+ * Usage:
+
+	TimerWheel timers;
+	//one-shot event 30 ticks from now:
+	TimerWheel::Handle h = timers.schedule(30, 0, [](){ ... });
+	//periodic event every 40 ticks, first one 40 ticks from now:
+	timers.schedule(40, 40, [](){ ... });
+	timers.cancel(h);
+	//once per tick:
+	timers.advance();
+
+ */
+
+#include <array>
+#include <vector>
+#include <functional>
+#include <cstdint>
+
+struct TimerWheel {
+	//identifies a scheduled timer; stays safe to cancel() after the timer fired or was cancelled:
+	typedef uint64_t Handle;
+	static constexpr Handle NoTimer = 0;
+
+	TimerWheel();
+
+	//call 'fn' after 'delay' (>= 1) ticks and then, if 'period' is non-zero, every 'period' ticks until cancelled:
+	Handle schedule(uint32_t delay, uint32_t period, std::function< void() > const &fn);
+
+	//stop a timer from firing (does nothing for NoTimer or timers that are already done):
+	void cancel(Handle handle);
+	//cancel and reset a stored handle:
+	void cancel_and_clear(Handle *handle) { cancel(*handle); *handle = NoTimer; }
+
+	//move forward one tick, calling every timer that comes due:
+	// (callbacks may freely schedule or cancel timers, including themselves)
+	void advance();
+
+	uint64_t now = 0; //ticks advanced so far
+	uint32_t pending = 0; //timers scheduled and not yet done
+	uint64_t fired = 0; //total timer callbacks run
+
+	//internals:
+	static constexpr uint32_t LevelBits = 8;
+	static constexpr uint32_t Slots = 1 << LevelBits;
+	static constexpr uint32_t Levels = 4;
+	static constexpr uint32_t None = ~uint32_t(0);
+
+	struct Timer {
+		uint64_t expires = 0;
+		uint32_t period = 0;
+		uint32_t generation = 1;
+		uint32_t prev = None, next = None;
+		uint32_t *list = nullptr; //head of the slot list this timer is in (nullptr when free)
+		std::function< void() > fn;
+	};
+	std::vector< Timer > timers; //pool, indexed by the low 32 bits of a Handle
+	std::vector< uint32_t > free_timers;
+	std::array< std::array< uint32_t, Slots >, Levels > wheel;
+	uint32_t firing = None; //timers being run by advance()
+
+	void link(uint32_t index, uint32_t *list);
+	void unlink(uint32_t index);
+	void insert(uint32_t index); //put timer in the slot matching its 'expires'
+	void release(uint32_t index);
+};
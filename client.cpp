@@ -10,6 +10,7 @@
 #include <SDL.h>
 
 #include <chrono>
+#include <cstdlib>
 #include <iostream>
 #include <stdexcept>
 #include <memory>
@@ -22,11 +23,15 @@ int main(int argc, char **argv) {
 #endif
 	std::string host = "128.2.13.145";
 	std::string port = "12345";
+	float interpolation_delay_ms = 100.0f; //how far behind the server other players are drawn (see PlayMode.hpp)
 	//------------ command line arguments ------------
-	if (argc == 3) {
+	if (argc == 3 || argc == 4) {
 		host = argv[1];
 		port = argv[2];
 	}
+	if (argc == 4) {
+		interpolation_delay_ms = std::max(0.0f, float(std::atof(argv[3])));
+	}
 
 	//------------ connect to server --------------
 	Client client(host, port);
@@ -98,7 +103,9 @@ int main(int argc, char **argv) {
 	call_load_functions();
 
 	//------------ create game mode + make current --------------
-	Mode::set_current(std::make_shared< PlayMode >(client));
+	std::shared_ptr< PlayMode > play = std::make_shared< PlayMode >(client);
+	play->interpolation_delay = interpolation_delay_ms / 1000.0f;
+	Mode::set_current(play);
 
 	//------------ main loop ------------
 
@@ -11,8 +11,8 @@
 // |sz|sz|sz|sz| <-- four byte (native endian) size
 // |TT...TT| * (sz/sizeof(TT)) <-- enough T structures to make up sz bytes
 
-template< typename T >
-void read_chunk(std::istream &from, std::string const &magic, std::vector< T > *to_) {
+template< typename T, typename A >
+void read_chunk(std::istream &from, std::string const &magic, std::vector< T, A > *to_) {
 	assert(to_);
 	auto &to = *to_;
 
@@ -42,8 +42,8 @@ void read_chunk(std::istream &from, std::string const &magic, std::vector< T > *
 
 
 //helper function to write a chunk of data in the same format as read_chunk:
-template< typename T >
-void write_chunk(std::string const &magic, std::vector< T > const &from, std::ostream *to_) {
+template< typename T, typename A >
+void write_chunk(std::string const &magic, std::vector< T, A > const &from, std::ostream *to_) {
 	assert(magic.size() == 4);
 	assert(to_);
 	auto &to = *to_;
@@ -0,0 +1,117 @@
+//replay re-runs recorded matches (see MatchRecord.hpp) as fast as possible,
+// checking that each one ends in the same state as it did on the server and
+// reporting how many ticks per second the simulation manages.
+//
+//A directory of recordings (the server's record-dir) doubles as a benchmark.
+
+#include "MatchRecord.hpp"
+#include "GameSim.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <stdexcept>
+#include <filesystem>
+#include <algorithm>
+#include <vector>
+#include <string>
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+	//when compiled on windows, unhandled exceptions don't have their message printed, which can make debugging simple issues difficult.
+	try {
+#endif
+
+	//------------ argument parsing ------------
+
+	uint32_t repeat = 1;
+	std::vector< std::string > paths;
+	for (int argi = 1; argi < argc; ++argi) {
+		std::string arg = argv[argi];
+		if (arg == "--repeat" && argi + 1 < argc) {
+			repeat = uint32_t(std::max(1, std::atoi(argv[argi + 1])));
+			argi += 1;
+		} else {
+			paths.emplace_back(arg);
+		}
+	}
+	if (paths.empty()) {
+		std::cerr << "Usage:\n\t./replay [--repeat N] <recording.match|directory> [...]" << std::endl;
+		std::cerr << "\t(each recording is re-simulated N times; directories are searched for .match files)" << std::endl;
+		return 1;
+	}
+
+	//expand directories into the recordings they contain:
+	std::vector< std::string > files;
+	for (auto const &path : paths) {
+		if (std::filesystem::is_directory(path)) {
+			std::vector< std::string > found;
+			for (auto const &entry : std::filesystem::directory_iterator(path)) {
+				if (entry.path().extension() == ".match") found.emplace_back(entry.path().string());
+			}
+			std::sort(found.begin(), found.end());
+			files.insert(files.end(), found.begin(), found.end());
+		} else {
+			files.emplace_back(path);
+		}
+	}
+
+	//------------ replay ------------
+
+	typedef std::chrono::steady_clock Clock;
+	uint64_t total_ticks = 0;
+	double total_seconds = 0.0;
+	uint32_t mismatches = 0, failures = 0;
+
+	for (auto const &file : files) {
+		MatchRecord record;
+		try {
+			record = MatchRecord::load(file);
+		} catch (std::exception const &e) {
+			std::cerr << file << ": " << e.what() << std::endl;
+			failures += 1;
+			continue;
+		}
+
+		bool match = true;
+		double best = 0.0;
+		for (uint32_t r = 0; r < repeat; ++r) {
+			GameSim sim(record.header.cols, record.header.rows, record.header.start_size);
+			auto before = Clock::now();
+			record.replay(sim);
+			double seconds = std::chrono::duration< double >(Clock::now() - before).count();
+
+			if (r == 0 || seconds < best) best = seconds;
+			total_seconds += seconds;
+			total_ticks += sim.tick;
+			if (sim.tick != record.header.final_tick || sim.state_hash() != record.header.final_hash) match = false;
+		}
+
+		std::cout << file << ": " << record.header.final_tick << " ticks, "
+			<< int(record.header.players) << " players, " << record.event_count << " events, "
+			<< std::fixed << std::setprecision(2) << best * 1e3 << " ms best ("
+			<< std::setprecision(0) << (best > 0.0 ? record.header.final_tick / best : 0.0) << " ticks/s)"
+			<< (match ? "" : " -- FINAL STATE MISMATCH") << std::endl;
+		if (!match) mismatches += 1;
+	}
+
+	std::cout << files.size() << " recordings";
+	if (total_seconds > 0.0) {
+		std::cout << ", " << total_ticks << " ticks in " << std::setprecision(3) << total_seconds << " s ("
+			<< std::setprecision(0) << total_ticks / total_seconds << " ticks/s)";
+	}
+	std::cout << ", " << mismatches << " mismatched, " << failures << " unreadable." << std::endl;
+
+	return (mismatches == 0 && failures == 0 ? 0 : 1);
+
+#ifdef _WIN32
+	} catch (std::exception const &e) {
+		std::cerr << "Unhandled exception:\n" << e.what() << std::endl;
+		return 1;
+	} catch (...) {
+		std::cerr << "Unhandled exception (unknown type)." << std::endl;
+		throw;
+	}
+#endif
+}
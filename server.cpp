@@ -2,96 +2,559 @@
 #include "Connection.hpp"
 
 #include "hex_dump.hpp"
+#include "Log.hpp"
+#include "Metrics.hpp"
+#include "TickScheduler.hpp"
+#include "TimerWheel.hpp"
+#include "Matchmaker.hpp"
+#include "Rng.hpp"
+#include "GameSim.hpp"
+#include "MatchRecord.hpp"
 
 #include <chrono>
+#include <cstdlib>
+#include <ctime>
 #include <stdexcept>
 #include <iostream>
 #include <cassert>
 #include <unordered_map>
-#include <deque>
+#include <list>
 #include <algorithm>
+#include <cstring>
+#include <random>
+#include <sstream>
+#include <array>
+#include <memory>
+#include <unordered_set>
+#include <memory_resource>
 
-const uint8_t NUM_ROWS = 20;
-const uint8_t NUM_COLS = 40;
-//const uint8_t MAX_NUM_PLAYERS = 4;
-const uint8_t START_GAME_PLAYERS = 2; // TODO support 4 player games
-const uint8_t START_HORIZONTAL_BORDER = (NUM_COLS - 10) / 2;
-const uint8_t START_VERTICAL_BORDER = (NUM_ROWS - 10) / 2;
+const uint32_t MAX_GAME_PLAYERS = GameSim::MaxPlayers; // (ids must fit in a tile's owner byte)
+const uint8_t DEFAULT_GAME_PLAYERS = 2;
 const uint8_t POWERUP_INTERVAL = 100; // 100 ticks = 10 seconds
 const uint8_t BORDER_DECREMENT = 1;
 const uint32_t LEVEL_GROW_INTERVAL = 40; // in ticks
+const size_t SPECTATOR_MAX_BACKLOG = 4096; // bytes of unsent data after which a spectator skips snapshots
+const uint32_t HASH_CHECK_INTERVAL = 10; // sim ticks between asking players for their board hash
+const size_t HASH_HISTORY = 16; // server hashes kept for checking (late) answers
+const uint8_t INPUT_QUEUE = 8; // 'b' messages held per player (one is applied per tick)
 
-struct Uvec2 {
-	Uvec2(const uint32_t &_x, const uint32_t &_y): x(_x), y(_x) { }
-	uint32_t x, y;
-	inline Uvec2& operator = (const Uvec2 &a) {
-		x = a.x;
-		y = a.y;
-		return *this;
+//metrics (see Metrics.hpp; also read by the scrape endpoint and snapshot file):
+static Metrics::Histogram &tick_work_us = Metrics::histogram("server_tick_work_us", "Work time per tick, in microseconds.");
+static Metrics::Counter &ticks_total = Metrics::counter("server_ticks_total", "Ticks run.");
+static Metrics::Counter &tick_overruns_total = Metrics::counter("server_tick_overruns_total", "Ticks whose work took longer than a tick period.");
+static Metrics::Counter &ticks_skipped_total = Metrics::counter("server_ticks_skipped_total", "Ticks skipped to catch up with the schedule.");
+static Metrics::Gauge &games_gauge = Metrics::gauge("server_games", "Games in progress.");
+static Metrics::Gauge &players_gauge = Metrics::gauge("server_players", "Players in games.");
+static Metrics::Gauge &spectators_gauge = Metrics::gauge("server_spectators", "Connections watching a game.");
+static Metrics::Gauge &connections_gauge = Metrics::gauge("server_connections", "Open client connections.");
+static Metrics::Gauge &queue_gauge = Metrics::gauge("server_matchmaking_queue", "Connections waiting for a game.");
+static Metrics::Gauge &send_buffer_gauge = Metrics::gauge("server_send_buffer_bytes", "Unsent bytes across all client connections.");
+static Metrics::Gauge &send_buffer_max_gauge = Metrics::gauge("server_send_buffer_max_bytes", "Unsent bytes on the most backed-up client connection.");
+static Metrics::Counter &desyncs_total = Metrics::counter("server_desyncs_total", "Board hashes from players that didn't match the server's.");
+static Metrics::Gauge &arena_bytes_gauge = Metrics::gauge("server_arena_bytes", "Bytes held by game arenas.");
+static Metrics::Counter &arena_blocks_total = Metrics::counter("server_arena_blocks_total", "Blocks game arenas have requested from the heap.");
+
+//count 'copies' messages of 'type' (each 'bytes' long) received from or queued to clients:
+void count_message(bool incoming, char type, size_t bytes, size_t copies = 1) {
+	static std::array< Metrics::Counter *, 256 > messages_in{}, bytes_in{}, messages_out{}, bytes_out{};
+	auto &messages = (incoming ? messages_in : messages_out);
+	auto &sizes = (incoming ? bytes_in : bytes_out);
+	uint8_t index = uint8_t(type);
+	if (!messages[index]) {
+		std::string label = std::string("{type=\"") + type + "\"}";
+		if (incoming) {
+			messages[index] = &Metrics::counter("server_messages_in_total" + label, "Messages received from clients, by type.");
+			sizes[index] = &Metrics::counter("server_bytes_in_total" + label, "Bytes received from clients, by message type.");
+		} else {
+			messages[index] = &Metrics::counter("server_messages_out_total" + label, "Messages queued to clients, by type.");
+			sizes[index] = &Metrics::counter("server_bytes_out_total" + label, "Bytes queued to clients, by message type.");
+		}
 	}
-	inline bool operator == (const Uvec2 &a) { return x == a.x && y == a.y; }
-	inline bool operator != (const Uvec2 &a) { return !(*this == a); }
-};
+	messages[index]->add(copies);
+	sizes[index]->add(bytes * copies);
+}
 
 //per-client state:
 struct PlayerInfo {
-	PlayerInfo(std::vector<Uvec2> &init_positions, uint8_t _id) { 
-		id = _id;
-		name = "Player " + std::to_string(id);
-		do {
-			x = (rand() % (NUM_COLS - START_HORIZONTAL_BORDER * 2)) + START_HORIZONTAL_BORDER;
-			y = (rand() % (NUM_ROWS - START_VERTICAL_BORDER * 2)) + START_VERTICAL_BORDER;
-		} while (std::find(init_positions.begin(),
-							init_positions.end(),
-							Uvec2(x, y))
-				!= init_positions.end());
-		init_positions.emplace_back(x, y);
-		
-		std::cout << name << " connected: (" + std::to_string(x) + ", " + std::to_string(y) + ");" << std::endl;
-	}
+	PlayerInfo(uint8_t _id) : name("Player " + std::to_string(_id)), id(_id) { }
 	std::string name;
-	uint8_t id;
-	uint8_t dir = 8;
-	uint8_t x, y;
+	uint8_t id; // index into the game's sim.players
+	uint16_t inputs = 0; // 'b' messages applied (wraps; echoed in 'y' so the client knows which inputs an update reflects)
+	//'b' messages not applied yet, oldest first (clients send one per tick, and jitter can bunch them up):
+	std::array< uint8_t, INPUT_QUEUE > queued{};
+	uint8_t queued_first = 0, queued_count = 0;
+};
+
+struct Spectator {
+	Connection *connection;
+	bool stale = true; // needs the whole board (just joined, or skipped some updates)
+};
+
+//where game arenas get their memory (counted, for the metrics):
+struct ArenaUpstream : std::pmr::memory_resource {
+	void *do_allocate(size_t bytes, size_t alignment) override {
+		void *block = std::pmr::new_delete_resource()->allocate(bytes, alignment);
+		arena_bytes_gauge.add(int64_t(bytes));
+		arena_blocks_total.add();
+		return block;
+	}
+	void do_deallocate(void *block, size_t bytes, size_t alignment) override {
+		std::pmr::new_delete_resource()->deallocate(block, bytes, alignment);
+		arena_bytes_gauge.add(-int64_t(bytes));
+	}
+	bool do_is_equal(std::pmr::memory_resource const &other) const noexcept override { return this == &other; }
 };
+static ArenaUpstream arena_upstream;
+
+//an arena big enough for everything a game on a cols x rows board with 'players' players holds
+// (board, free tile index, change list, player table, and room for the record's events and spectators):
+size_t arena_size_for(uint16_t cols, uint16_t rows, uint32_t players) {
+	size_t cells = size_t(cols) * size_t(rows);
+	return cells * (2 + sizeof(uint32_t) + 1 + 2 * sizeof(uint32_t)) // kinds, owners, births, tile_changed, free_tiles
+	     + cells // changed_tiles (typical; it grows into new blocks if a tick changes more)
+	     + (size_t(cols) + 2) * (size_t(rows) + 2) // fill_grid
+	     + GameSim::FillStackReserve * (size_t(cols) + size_t(rows) + 2) * sizeof(uint32_t) // fill_stack
+	     + 2 * ((size_t(cols) + 2 + 63) / 64) * (size_t(rows) + 2) * sizeof(uint64_t) // fill_bits (two bitboards)
+	     + GameSim::MaxPlayers * sizeof(GameSim::Player)
+	     + size_t(players) * 128 // player map nodes and buckets
+	     + size_t(players) * 2 * GameSim::TrailCapacity * sizeof(GameSim::TrailEntry) // trail rings (grown as players are added)
+	     + sizeof(MatchRecord::Chunk) + 64 // the record's first chunk of events (later ones come from new arena blocks as needed)
+	     + 64 * 1024; // spectators, hash checks
+}
 
+//everything belonging to one game lives in its arena, so starting a game is a couple of
+// allocations and ending it hands the arena's blocks back all at once (nothing is freed piece by piece):
 struct Game {
-	bool game_over = false;
+	typedef std::pmr::unordered_map< Connection *, PlayerInfo > Players;
+
+	Game(uint32_t id_, uint64_t seed_, uint16_t cols, uint16_t rows, uint32_t player_count)
+		: arena(arena_size_for(cols, rows, player_count), &arena_upstream),
+		  id(id_), seed(seed_), sim(cols, rows, GameSim::start_size_for(player_count), &arena),
+		  players(&arena), spectators(&arena), record(&arena) {
+		rng.seed(seed);
+		players.reserve(player_count);
+	}
+	Game(Game const &) = delete; // (everything points into 'arena')
+
+	std::pmr::monotonic_buffer_resource arena; // (first, so it outlives everything allocated from it)
+	uint32_t id = 0;
+	uint64_t seed = 0;
+	Rng rng; // all of this game's randomness comes from here, so it can be re-run from 'seed'
+	GameSim sim; // the authoritative board
+	bool game_over = false; // (set once the 'w' message has gone out)
 	uint8_t start_countdown = 30; // 30 ticks = 3 seconds
-	uint32_t tick = 0;
-	bool powerup_placed = false;
-	uint32_t powerup_timer = POWERUP_INTERVAL;
-	uint8_t powerup_x, powerup_y;
-	std::unordered_map< Connection *, PlayerInfo > players;
-	std::vector<Uvec2> init_positions;
-	uint8_t horizontal_border = START_HORIZONTAL_BORDER; // size of L/R walls
-	uint8_t vertical_border = START_VERTICAL_BORDER; // size of T/B walls
+	Players players;
+	std::pmr::vector< Spectator > spectators; // watching, but not playing
+	uint32_t spectator_skips = 0; // snapshots not sent to spectators that were falling behind
+	bool recording = false; // (only when there is a record_dir to save to; otherwise 'record' stays empty)
+	MatchRecord record; // everything done to 'sim', so the game can be re-run
+	//(sim tick, sim.board_hash()) for recent hash checks, oldest overwritten first
+	// (a fixed ring, since an arena never reuses memory that is given back):
+	std::array< std::pair< uint32_t, uint64_t >, HASH_HISTORY > hash_history{};
+	uint32_t hash_checks = 0; // (hash_history[hash_checks % HASH_HISTORY] is next)
+	bool record_saved = false;
+
+	//scheduled events (on the global 'timers' wheel):
+	TimerWheel::Handle countdown_timer = TimerWheel::NoTimer; // every tick until the game starts
+	TimerWheel::Handle border_timer = TimerWheel::NoTimer; // every LEVEL_GROW_INTERVAL once started
+	TimerWheel::Handle powerup_timer = TimerWheel::NoTimer; // POWERUP_INTERVAL after last powerup placed/taken
+
+	//spectators that can't keep up skip messages until they drain, then get the whole board again:
+	bool falling_behind(Spectator &s) {
+		if (s.connection->send_buffer.size() <= SPECTATOR_MAX_BACKLOG) return false;
+		spectator_skips++;
+		s.stale = true;
+		return true;
+	}
+
+	//append an already-encoded message to every player and to every spectator that is keeping up
+	// (stale spectators don't need it: the whole board they get next covers it):
+	void broadcast(std::vector< char > const &message) {
+		size_t copies = players.size();
+		for (auto& it : players) {
+			it.first->send_raw(message.data(), message.size());
+		}
+		for (auto& s : spectators) {
+			if (s.stale || falling_behind(s)) continue;
+			s.connection->send_raw(message.data(), message.size());
+			copies += 1;
+		}
+		count_message(false, message[0], message.size(), copies);
+	}
 };
 
-static std::deque<Connection *> matchmaking_queue;
-static std::vector<Game> games;
+static Matchmaker matchmaker(DEFAULT_GAME_PLAYERS);
+static std::list<Game> games; // (list, so timer callbacks can hold on to Game pointers)
+static uint32_t next_game_id = 1;
+static TimerWheel timers; // advanced once per tick
+static Rng seed_rng; // picks each game's seed (seeded at startup)
+static std::string record_dir; // where finished games are recorded (empty = don't save recordings)
+static uint16_t board_cols = GameSim::DefaultCols, board_rows = GameSim::DefaultRows; // size of new games' boards
 
-//static uint8_t winner_id;
-//static size_t winner_score = 0;
-//static bool GAME_OVER = false;
+//a run of encoded messages, remembering the type and size of each one (for the metrics):
+struct Outgoing {
+	std::vector< char > data;
+	std::vector< std::pair< char, uint32_t > > messages;
 
-void add_to_matchmaking_queue(Connection* c) {
-	matchmaking_queue.emplace_back(c);
-	for (Connection* cc : matchmaking_queue) {
-		cc->send('q');
-		cc->send(uint8_t(matchmaking_queue.size()));
+	//call with data.size() from before each message was appended:
+	void ended(size_t start) { messages.emplace_back(data[start], uint32_t(data.size() - start)); }
+	void clear() { data.clear(); messages.clear(); }
+	bool empty() const { return data.empty(); }
+	void send(Connection *c) const { c->send_raw(data.data(), data.size()); }
+	//after sending to 'copies' connections:
+	void count(size_t copies) const {
+		if (copies == 0) return;
+		for (auto const &m : messages) count_message(false, m.first, m.second, copies);
 	}
-	if (matchmaking_queue.size() >= START_GAME_PLAYERS) { // we have enough players to start a game
-		games.push_back(Game());
-		for (uint8_t i = 0; i < START_GAME_PLAYERS; i++) {
-			Connection* cc = matchmaking_queue.front();
-			matchmaking_queue.pop_front();
-			games.back().players.emplace(cc, PlayerInfo(games.back().init_positions, i));
-			cc->send('i');
-			cc->send(i);
-			cc->send('g');
-			cc->send(uint8_t(games.back().horizontal_border));
-			cc->send(uint8_t(games.back().vertical_border));
+};
+
+//helpers for building messages:
+template< typename T >
+void append(std::vector< char > &buffer, T const &t) {
+	buffer.insert(buffer.end(), reinterpret_cast< char const * >(&t), reinterpret_cast< char const * >(&t) + sizeof(T));
+}
+
+//(coordinates and sizes on the wire are 2 bytes each)
+
+//'m' + cols + rows -- the board size (the client starts over with an empty board of that size):
+void encode_board_size(GameSim const &sim, Outgoing &out) {
+	size_t start = out.data.size();
+	out.data.push_back('m');
+	append(out.data, uint16_t(sim.cols));
+	append(out.data, uint16_t(sim.rows));
+	out.ended(start);
+}
+
+//'g' + horizontal border + vertical border:
+void encode_borders(GameSim const &sim, Outgoing &out) {
+	size_t start = out.data.size();
+	out.data.push_back('g');
+	append(out.data, uint16_t(sim.horizontal_border));
+	append(out.data, uint16_t(sim.vertical_border));
+	out.ended(start);
+}
+
+//'s' + ticks left before the game starts (0 once it has):
+void encode_countdown(Game const &game, Outgoing &out) {
+	size_t start = out.data.size();
+	out.data.push_back('s');
+	out.data.push_back(char(game.start_countdown));
+	out.ended(start);
+}
+
+//'p' + type + x + y:
+void encode_powerup(GameSim const &sim, Outgoing &out) {
+	size_t start = out.data.size();
+	out.data.push_back('p');
+	out.data.push_back(char(sim.powerup.type));
+	append(out.data, uint16_t(sim.powerup.x));
+	append(out.data, uint16_t(sim.powerup.y));
+	out.ended(start);
+}
+
+//'t' + count + count * (x, y, kind, owner) for the listed tiles (y * cols + x);
+// more than 0xffff tiles are split over several messages:
+void encode_tiles(GameSim const &sim, std::pmr::vector< uint32_t > const &indices, Outgoing &out) {
+	for (size_t begin = 0; begin < indices.size(); begin += 0xffff) {
+		size_t end = std::min(indices.size(), begin + 0xffff);
+		size_t start = out.data.size();
+		out.data.push_back('t');
+		append(out.data, uint16_t(end - begin));
+		for (size_t i = begin; i < end; ++i) {
+			uint16_t x = uint16_t(indices[i] % sim.cols);
+			uint16_t y = uint16_t(indices[i] / sim.cols);
+			GameSim::Tile const &tile = sim.at(x, y);
+			append(out.data, x);
+			append(out.data, y);
+			out.data.push_back(char(tile.kind));
+			out.data.push_back(char(tile.owner));
+		}
+		out.ended(start);
+	}
+}
+
+//'a' + n + n * (id, dir, x, y, powerup, area) for the players still in the game:
+void encode_players(Game const &game, Outgoing &out) {
+	size_t start = out.data.size();
+	out.data.push_back('a');
+	out.data.push_back(0); // (count, filled in below)
+	out.data.reserve(out.data.size() + game.sim.players.size() * 11);
+	uint8_t count = 0;
+	for (uint32_t id = 0; id < game.sim.players.size(); ++id) {
+		GameSim::Player const &player = game.sim.players[id];
+		if (!player.active) continue;
+		count += 1;
+		out.data.push_back(char(id));
+		out.data.push_back(char(player.dir));
+		append(out.data, uint16_t(player.pos.x));
+		append(out.data, uint16_t(player.pos.y));
+		out.data.push_back(char(player.powerup));
+		append(out.data, uint32_t(player.area));
+	}
+	out.data[start + 1] = char(count);
+	out.ended(start);
+}
+
+//'w' + winner + area:
+void encode_winner(Game const &game, Outgoing &out) {
+	size_t start = out.data.size();
+	out.data.push_back('w');
+	out.data.push_back(char(game.sim.winner));
+	append(out.data, uint32_t(game.sim.winner_area));
+	out.ended(start);
+}
+
+//'k' + tick -- asks players to answer with their board hash as of this tick:
+void encode_hash_check(GameSim const &sim, Outgoing &out) {
+	size_t start = out.data.size();
+	out.data.push_back('k');
+	append(out.data, uint32_t(sim.tick));
+	out.ended(start);
+}
+
+//compare a player's answer to a hash check with the server's board:
+void check_hash(Game &game, PlayerInfo const &player, uint32_t tick, uint64_t hash) {
+	auto end = game.hash_history.begin() + std::min< size_t >(game.hash_checks, HASH_HISTORY);
+	auto f = std::find_if(game.hash_history.begin(), end, [tick](auto const &h) { return h.first == tick; });
+	if (f == end) return; // (too old to check)
+	if (f->second != hash) {
+		desyncs_total.add();
+		Log::warn("desync in game {}: {} disagrees with the server at tick {} (hash {} vs {})", game.id, player.name, tick, hash, f->second);
+	}
+}
+
+//everything a client needs to catch up with the current state of the game
+// (the board starts over empty, so only the tiles that aren't empty are sent):
+void encode_full(Game const &game, Outgoing &out) {
+	GameSim const &sim = game.sim;
+	encode_board_size(sim, out);
+	encode_borders(sim, out);
+	encode_countdown(game, out);
+	encode_powerup(sim, out);
+	std::pmr::vector< uint32_t > owned; // (on the default heap; encode_tiles takes the same type as sim.changed_tiles)
+	for (uint16_t y = 0; y < sim.rows; ++y) {
+		for (uint16_t x = 0; x < sim.cols; ++x) {
+			if (sim.at(x, y).kind != GameSim::Tile::Empty) owned.emplace_back(uint32_t(y) * sim.cols + x);
+		}
+	}
+	encode_tiles(sim, owned, out);
+	encode_players(game, out);
+	if (game.game_over) encode_winner(game, out);
+}
+
+void place_powerup(Game* game);
+
+//(re)start the wait for the next powerup:
+void schedule_powerup(Game* game) {
+	timers.cancel(game->powerup_timer);
+	game->powerup_timer = timers.schedule(POWERUP_INTERVAL, 0, [game](){
+		game->powerup_timer = TimerWheel::NoTimer;
+		place_powerup(game);
+	});
+}
+
+//put a powerup of random type on a random free tile (sent with this tick's updates):
+void place_powerup(Game* game) {
+	schedule_powerup(game);
+	if (game->recording) game->record.add(game->sim.tick, MatchRecord::Event::Powerup);
+	game->sim.place_powerup(game->rng); // (if the board is full, try again later)
+}
+
+//count down to the start of the game, then start growing the board and spawning powerups:
+void schedule_start(Game* game) {
+	game->countdown_timer = timers.schedule(1, 1, [game](){
+		game->start_countdown--;
+		game->broadcast({'s', char(game->start_countdown)});
+		if (game->start_countdown > 0) return;
+
+		timers.cancel_and_clear(&game->countdown_timer);
+		game->border_timer = timers.schedule(LEVEL_GROW_INTERVAL, LEVEL_GROW_INTERVAL, [game](){
+			GameSim &sim = game->sim;
+			uint16_t h = uint16_t(std::max(0, sim.horizontal_border - BORDER_DECREMENT));
+			uint16_t v = uint16_t(std::max(0, sim.vertical_border - BORDER_DECREMENT));
+			sim.set_borders(h, v);
+			if (game->recording) game->record.add(sim.tick, MatchRecord::Event::Borders, h, v);
+			Outgoing borders;
+			encode_borders(sim, borders);
+			game->broadcast(borders.data);
+		});
+		schedule_powerup(game);
+	});
+}
+
+bool remove_spectator(Connection* c);
+
+//start watching game 'id' (or, if there is no such game, the newest game) instead of whatever 'c' was watching:
+void add_spectator(Connection* c, uint32_t id) {
+	remove_spectator(c);
+	if (games.empty()) {
+		c->send('v');
+		c->send(uint32_t(0));
+		return;
+	}
+	auto game = std::find_if(games.begin(), games.end(), [&](Game const &g) { return g.id == id; });
+	if (game == games.end()) game = std::prev(games.end());
+
+	//(the board is sent along with the next tick's updates)
+	game->spectators.emplace_back(Spectator{c});
+	c->user_data = &*game;
+	c->send('v');
+	c->send(uint32_t(game->id));
+	count_message(false, 'v', 5);
+	Log::info("spectator joined game {} ({} watching)", game->id, game->spectators.size());
+}
+
+//stop watching whatever game 'c' is watching; returns false if it wasn't watching one:
+bool remove_spectator(Connection* c) {
+	Game *game = static_cast< Game * >(c->user_data); // (set by add_spectator, so only that game needs looking at)
+	if (!game) return false;
+	c->user_data = nullptr;
+	auto f = std::find_if(game->spectators.begin(), game->spectators.end(), [c](Spectator const &s) { return s.connection == c; });
+	assert(f != game->spectators.end());
+	game->spectators.erase(f);
+	return true;
+}
+
+//queue a 'b' for the next tick without one
+// (if the queue is full, the oldest is dropped -- it counts as applied, and the client's prediction catches up from the update):
+void queue_input(PlayerInfo &player, uint8_t dir) {
+	if (player.queued_count == INPUT_QUEUE) {
+		player.queued_first = uint8_t((player.queued_first + 1) % INPUT_QUEUE);
+		player.queued_count -= 1;
+		player.inputs += 1;
+	}
+	player.queued[(player.queued_first + player.queued_count) % INPUT_QUEUE] = dir;
+	player.queued_count += 1;
+}
+
+//apply the player's next queued input, if any (without one, they keep going the way they were):
+void apply_input(Game &game, PlayerInfo &player) {
+	if (player.queued_count == 0) return;
+	uint8_t next = player.queued[player.queued_first];
+	player.queued_first = uint8_t((player.queued_first + 1) % INPUT_QUEUE);
+	player.queued_count -= 1;
+	player.inputs += 1;
+
+	GameSim::Dir &dir = game.sim.players[player.id].dir;
+	GameSim::Dir before = dir;
+	game.sim.set_input(player.id, GameSim::Dir(next));
+	if (game.recording && dir != before) game.record.add(game.sim.tick, MatchRecord::Event::Input, player.id, dir);
+}
+
+//write the game's record to record_dir (once, when the game is won or abandoned):
+void save_record(Game &game) {
+	if (!game.recording || game.record_saved) return;
+	game.record_saved = true;
+	game.record.finish(game.sim);
+	std::ostringstream path;
+	path << record_dir << "/game-" << std::hex << game.seed << ".match";
+	try {
+		game.record.save(path.str());
+		Log::info("game {} recorded to '{}' ({} events)", game.id, path.str(), game.record.event_count);
+	} catch (std::exception const &e) {
+		Log::warn("game {} not recorded: {}", game.id, e.what());
+	}
+}
+
+//remove an empty game; its spectators move on to the newest remaining game:
+void remove_game(std::list<Game>::iterator game) {
+	save_record(*game);
+	timers.cancel(game->countdown_timer);
+	timers.cancel(game->border_timer);
+	timers.cancel(game->powerup_timer);
+	std::vector< Spectator > spectators(game->spectators.begin(), game->spectators.end());
+	Log::info("empty game {}, removing", game->id);
+	games.erase(game);
+	for (auto& s : spectators) {
+		s.connection->user_data = nullptr; // (its game is gone)
+		add_spectator(s.connection, 0);
+	}
+}
+
+//take a player out of a game (their trail goes away with them); removes the game if it is now empty:
+void leave_game(std::list<Game>::iterator game, Game::Players::iterator player) {
+	game->sim.remove_player(player->second.id);
+	if (game->recording) game->record.add(game->sim.tick, MatchRecord::Event::Leave, player->second.id);
+	game->players.erase(player);
+	if (game->players.size() == 0) {
+		remove_game(game);
+	}
+}
+
+//create a game for a group of players that the matchmaker put together:
+void start_game(std::vector< Connection * > const &players) {
+	uint64_t seed = (uint64_t(seed_rng()) << 32) | seed_rng();
+	games.emplace_back(next_game_id++, seed, board_cols, board_rows, uint32_t(players.size()));
+	Game &game = games.back();
+	game.recording = !record_dir.empty();
+	if (game.recording) {
+		game.record.header.seed = game.seed;
+		game.record.header.start_size = GameSim::start_size_for(uint32_t(players.size()));
+		game.record.header.game_id = game.id;
+		game.record.header.players = uint8_t(players.size());
+	}
+	{
+		std::ostringstream seed_hex;
+		seed_hex << std::hex << game.seed;
+		Log::info("game {} starting with seed 0x{}", game.id, seed_hex.str());
+	}
+	Outgoing board;
+	encode_board_size(game.sim, board);
+	encode_borders(game.sim, board);
+	for (uint8_t i = 0; i < players.size(); i++) {
+		Connection* cc = players[i];
+		auto &info = game.players.emplace(cc, PlayerInfo(i)).first->second;
+		game.sim.add_player(i, game.rng);
+		if (game.recording) game.record.add(game.sim.tick, MatchRecord::Event::Join, i);
+		GameSim::Pos const &pos = game.sim.players[i].pos;
+		Log::info("{} connected: ({}, {});", info.name, pos.x, pos.y);
+		cc->send('i');
+		cc->send(i);
+		board.send(cc);
+	}
+	count_message(false, 'i', 2, players.size());
+	board.count(players.size());
+	schedule_start(&game);
+}
+
+//answer plain-text metrics scrapes: any request gets the current metrics, then the connection is closed once they're sent:
+void serve_metrics(Server &metrics_server) {
+	static std::unordered_set< Connection * > answered;
+	metrics_server.poll([](Connection *c, Connection::Event evt) {
+		if (evt == Connection::OnClose) {
+			answered.erase(c);
+			return;
+		}
+		if (evt != Connection::OnRecv || answered.count(c)) return;
+
+		//wait for the whole request (an HTTP request ends with a blank line; anything else with a newline):
+		std::string request(c->recv_buffer.begin(), c->recv_buffer.end());
+		size_t line_end = request.find('\n');
+		if (line_end == std::string::npos) return;
+		bool http = (request.substr(0, line_end).find(" HTTP/") != std::string::npos);
+		if (http && request.find("\r\n\r\n") == std::string::npos && request.find("\n\n") == std::string::npos) {
+			if (request.size() > 8192) c->close();
+			return;
+		}
+		c->recv_buffer.clear();
+
+		std::string body = Metrics::render();
+		std::string response;
+		if (http) {
+			response = "HTTP/1.0 200 OK\r\n"
+				"Content-Type: text/plain; version=0.0.4\r\n"
+				"Content-Length: " + std::to_string(body.size()) + "\r\n"
+				"Connection: close\r\n\r\n";
+		}
+		response += body;
+		c->send_raw(response.data(), response.size());
+		answered.insert(c);
+	}, 0.0);
+
+	for (auto &c : metrics_server.connections) {
+		if (c.socket != InvalidSocket && c.send_buffer.empty() && answered.count(&c)) {
+			answered.erase(&c);
+			c.close();
 		}
 	}
 }
@@ -104,56 +567,96 @@ int main(int argc, char **argv) {
 
 	//------------ argument parsing ------------
 
-	if (argc != 2) {
-		std::cerr << "Usage:\n\t./server <port>" << std::endl;
+	if (argc < 2 || argc > 8) {
+		std::cerr << "Usage:\n\t./server <port> [tick-rate] [players-per-game] [metrics-port] [metrics-file] [record-dir] [board-size]" << std::endl;
+		std::cerr << "\t(metrics-port serves plain-text metrics on 127.0.0.1; metrics-file is rewritten every 10 seconds; '-' skips either)" << std::endl;
+		std::cerr << "\t(record-dir gets a .match file for every finished game, for use with ./replay; '-' skips it)" << std::endl;
+		std::cerr << "\t(board-size is COLSxROWS, e.g. 40x20, between " << GameSim::MinSize << " and " << GameSim::MaxSize << " each;" << std::endl;
+		std::cerr << "\t large games need room to start: e.g. 64 players need at least 16x16, 128 players 23x23)" << std::endl;
+		return 1;
+	}
+
+	double tick_rate = 10.0; //ticks per second
+	if (argc >= 3) {
+		tick_rate = std::atof(argv[2]);
+	}
+	if (argc >= 4) {
+		int players = std::atoi(argv[3]);
+		if (players < 2 || uint32_t(players) > MAX_GAME_PLAYERS) {
+			std::cerr << "Players per game must be between 2 and " << MAX_GAME_PLAYERS << "." << std::endl;
+			return 1;
+		}
+		matchmaker.players_per_match = uint32_t(players);
+	}
+
+	if (argc >= 7 && std::string(argv[6]) != "-") {
+		record_dir = argv[6];
+	}
+	if (argc >= 8) {
+		unsigned cols = 0, rows = 0;
+		char x = '\0';
+		std::istringstream size(argv[7]);
+		if (!(size >> cols >> x >> rows) || x != 'x'
+		 || cols < GameSim::MinSize || cols > GameSim::MaxSize || rows < GameSim::MinSize || rows > GameSim::MaxSize) {
+			std::cerr << "Board size must be COLSxROWS with each between " << GameSim::MinSize << " and " << GameSim::MaxSize << "." << std::endl;
+			return 1;
+		}
+		board_cols = uint16_t(cols);
+		board_rows = uint16_t(rows);
+	}
+	if (GameSim::start_size_for(matchmaker.players_per_match) > std::min(board_cols, board_rows)) {
+		uint16_t needed = GameSim::start_size_for(matchmaker.players_per_match);
+		std::cerr << matchmaker.players_per_match << " players need a board of at least " << needed << "x" << needed << "." << std::endl;
 		return 1;
 	}
 
 	//------------ initialization ------------
 
 	Server server(argv[1]);
-	srand ((uint32_t)time(NULL)); // initialize random seed
+	std::unique_ptr< Server > metrics_server;
+	if (argc >= 5 && std::string(argv[4]) != "-") {
+		metrics_server.reset(new Server(argv[4], "127.0.0.1"));
+	}
+	if (argc >= 6 && std::string(argv[5]) != "-") {
+		Metrics::write_snapshots(argv[5], 10.0);
+	}
+	seed_rng.seed((uint64_t(std::random_device()()) << 32) ^ uint64_t(time(NULL))); // initialize random seed
 
 	//------------ main loop ------------
-	constexpr float ServerTick = 1.0f / 10.0f; //TODO: set a server tick that makes sense for your game
+	TickScheduler scheduler(tick_rate);
+	//(also sets up this thread's log ring before the first tick)
+	Log::info("Running at {} ticks per second, {} players per game, {}x{} boards.", scheduler.tick_rate(), matchmaker.players_per_match, board_cols, board_rows);
 
 	while (true) {
-		static auto next_tick = std::chrono::steady_clock::now() + std::chrono::duration< double >(ServerTick);
-		//process incoming data from clients until a tick has elapsed:
-		while (true) {
-			auto now = std::chrono::steady_clock::now();
-			double remain = std::chrono::duration< double >(next_tick - now).count();
-			if (remain < 0.0) {
-				next_tick += std::chrono::duration< double >(ServerTick);
+		//process incoming data from clients until the next tick is due:
+		while (!scheduler.tick_due()) {
+			double remain = scheduler.time_until_tick();
+			if (remain < TickScheduler::MinPollWait) {
+				//too close to the deadline for select() to be worthwhile, so just wait it out:
+				scheduler.wait_for_tick();
 				break;
 			}
+			if (metrics_server) serve_metrics(*metrics_server);
 			server.poll([&](Connection* c, Connection::Event evt) {
 				if (evt == Connection::OnOpen) {
-					std::cout << "connected" << '\n';
+					Log::info("connected");
 					//client connected:
 				}
 				else if (evt == Connection::OnClose) {
 					//client disconnected:
 					//remove them from the matchmaking queue
-					auto f = std::find(matchmaking_queue.begin(), matchmaking_queue.end(), c);
-					if (f != matchmaking_queue.end()) {
-						matchmaking_queue.erase(f);
-						for (Connection* c : matchmaking_queue) {
-							c->send('q');
-							c->send(uint8_t(matchmaking_queue.size()));
-						}
-					}
+					matchmaker.remove(c);
+
+					//remove them from any spectator list:
+					remove_spectator(c);
 
 					//remove them from the players list:
 					for (auto it = games.rbegin(); it != games.rend(); it++) {
 						auto &game = *it;
 						auto f = game.players.find(c);
 						if (f != game.players.end()) {
-							game.players.erase(f);
-							if (game.players.size() == 0) {
-								games.erase(std::next(it).base());
-								std::cout << "empty game, removing" << std::endl;
-							}
+							leave_game(std::next(it).base(), f);
+							break;
 						}
 					}
 				}
@@ -162,7 +665,23 @@ int main(int argc, char **argv) {
 
 					// check if it's a join queue from main menu screen (this only occurs once per connection)
 					if (c->recv_buffer.size() >= 1 && c->recv_buffer[0] == 'q') {
-						add_to_matchmaking_queue(c);
+						matchmaker.add(c);
+						count_message(true, 'q', 1);
+						c->recv_buffer.erase(c->recv_buffer.begin(), c->recv_buffer.begin() + 1);
+					}
+
+					// spectate request from main menu: 'v' + 4-byte game id (0 = any game)
+					if (c->recv_buffer.size() >= 5 && c->recv_buffer[0] == 'v') {
+						uint32_t id;
+						std::memcpy(&id, c->recv_buffer.data() + 1, sizeof(id));
+						add_spectator(c, id);
+						count_message(true, 'v', 5);
+						c->recv_buffer.erase(c->recv_buffer.begin(), c->recv_buffer.begin() + 5);
+					}
+
+					// spectator going back to the main menu:
+					if (c->recv_buffer.size() >= 1 && c->recv_buffer[0] == 'd' && remove_spectator(c)) {
+						count_message(true, 'd', 1);
 						c->recv_buffer.erase(c->recv_buffer.begin(), c->recv_buffer.begin() + 1);
 					}
 
@@ -179,37 +698,29 @@ int main(int argc, char **argv) {
 								
 								if (type == 'b') {
 									if (c->recv_buffer.size() < 2) break;
-									player.dir = c->recv_buffer[1];
+									queue_input(player, uint8_t(c->recv_buffer[1]));
+									count_message(true, 'b', 2);
 									c->recv_buffer.erase(c->recv_buffer.begin(), c->recv_buffer.begin() + 2);
 								}
+								else if (type == 'h') { // answer to a hash check: 4-byte tick + 8-byte board hash
+									if (c->recv_buffer.size() < 13) break;
+									uint32_t tick;
+									uint64_t hash;
+									std::memcpy(&tick, c->recv_buffer.data() + 1, sizeof(tick));
+									std::memcpy(&hash, c->recv_buffer.data() + 5, sizeof(hash));
+									check_hash(game, player, tick, hash);
+									count_message(true, 'h', 13);
+									c->recv_buffer.erase(c->recv_buffer.begin(), c->recv_buffer.begin() + 13);
+								}
 								else if (type == 'd') { // disconnect from game, go back to lobby
-									game.players.erase(f);
-									if (game.players.size() == 0) {
-										games.erase(std::next(it).base());
-										std::cout << "empty game, removing" << std::endl;
-									}
-									add_to_matchmaking_queue(c);
+									count_message(true, 'd', 1);
 									c->recv_buffer.erase(c->recv_buffer.begin(), c->recv_buffer.begin() + 1);
-								}
-								else if (type == 'l') {
-									if (c->recv_buffer.size() < 3) break;
-									game.powerup_timer = POWERUP_INTERVAL;
-									game.powerup_placed = true;
-									game.powerup_x = c->recv_buffer[1];
-									game.powerup_y = c->recv_buffer[2];
-									uint8_t powerup_type = rand() % 2;
-									for (auto& it : game.players) {
-										auto& c = it.first;
-										c->send('p');
-										c->send(powerup_type);
-										c->send(game.powerup_x);
-										c->send(game.powerup_y);
-									}
-									c->recv_buffer.erase(c->recv_buffer.begin(), c->recv_buffer.begin() + 3);
+									leave_game(std::next(it).base(), f);
+									matchmaker.add(c);
+									return;
 								}
 								else {
-									std::cout << "Unrecognized message received from client! recv_buffer = " << std::endl;
-									std::cout << hex_dump(c->recv_buffer) << std::endl;
+									Log::warn("Unrecognized message received from client! recv_buffer =\n{}", hex_dump(c->recv_buffer));
 									//shut down client connection:
 									c->close();
 									return;
@@ -221,102 +732,129 @@ int main(int argc, char **argv) {
 				}, remain);
 		}
 
+		uint64_t skipped_before = scheduler.skipped_ticks;
+		scheduler.begin_tick();
+		ticks_skipped_total.add(scheduler.skipped_ticks - skipped_before);
+
+		//start games for everyone who queued up this tick (the rest hear how the queue stands):
+		size_t queue_statuses = matchmaker.tick(start_game);
+		count_message(false, 'q', 3, queue_statuses);
+
+		//run countdowns, border growth and powerup spawns that are due this tick:
+		timers.advance();
+
+		//update current game states and send the results to all clients in all games
+		// (updates are encoded once per game and the same bytes go to every player and spectator)
+		Outgoing update, full;
 		for (auto& game : games) {
-			if (game.start_countdown > 0) {
-				game.start_countdown--;
-				for (auto& it : game.players) {
-					auto &c = it.first;
-					c->send('s');
-					c->send(uint8_t(game.start_countdown));
-				}
+			GameSim &sim = game.sim;
+			//one input per player per tick, so each input the client sends moves it once (see PlayMode::predict_tick):
+			for (auto& it : game.players) {
+				apply_input(game, it.second);
 			}
-			else {
-				game.tick++;
-				if (game.tick % LEVEL_GROW_INTERVAL == 0) {
-					game.horizontal_border = std::max(0, game.horizontal_border - BORDER_DECREMENT);
-					game.vertical_border = std::max(0, game.vertical_border - BORDER_DECREMENT);
-
-					for (auto& it : game.players) {
-						auto& c = it.first;
-						c->send('g');
-						c->send(uint8_t(game.horizontal_border));
-						c->send(uint8_t(game.vertical_border));
-					}
-				}
-				game.powerup_timer--;
-				if (game.powerup_timer == 0) {
-					// ask a player to generate a powerup location
-					game.players.begin()->first->send('l');
+			bool stepped = false;
+			if (game.start_countdown == 0 && !game.game_over) {
+				sim.step();
+				stepped = true;
+				//powerup was picked up, wait for the next one:
+				if (sim.powerup_changed && sim.powerup.type == GameSim::no_powerup) {
+					schedule_powerup(&game);
 				}
 			}
-		}
 
-		//update current game states
-		// update player position
-		for (auto& game : games) {
-			if (game.start_countdown == 0) {
-				for (auto& it : game.players) {
-					auto& player = it.second;
-					if (player.dir == 8) continue; // none
-					if (player.dir % 4 == 0 && player.x > game.horizontal_border) { // left
-						player.x--;
-					}
-					else if (player.dir % 4 == 1 && player.x < NUM_COLS - 1 - game.horizontal_border) { // right
-						player.x++;
-					}
-					else if (player.dir % 4 == 2 && player.y < NUM_ROWS - 1 - game.vertical_border) { // up
-						player.y++;
-					}
-					else if (player.dir % 4 == 3 && player.y > game.vertical_border) { // down
-						player.y--;
-					}
-					if (3 < player.dir) { // ll/rr/uu/dd
-						if (player.dir % 4 == 0 && player.x > game.horizontal_border) { // left
-							player.x--;
-						}
-						else if (player.dir % 4 == 1 && player.x < NUM_COLS - 1 - game.horizontal_border) { // right
-							player.x++;
-						}
-						else if (player.dir % 4 == 2 && player.y < NUM_ROWS - 1 - game.vertical_border) { // up
-							player.y++;
-						}
-						else if (player.dir % 4 == 3 && player.y > game.vertical_border) { // down
-							player.y--;
-						}
-					}
+			update.clear();
+			if (sim.powerup_changed) {
+				encode_powerup(sim, update);
+			}
+			if (!sim.changed_tiles.empty()) {
+				encode_tiles(sim, sim.changed_tiles, update);
+			}
+			encode_players(game, update);
+			if (sim.game_over && !game.game_over) {
+				game.game_over = true;
+				timers.cancel_and_clear(&game.border_timer);
+				timers.cancel_and_clear(&game.powerup_timer);
+				Log::info("game {} won by player {} with {} tiles", game.id, sim.winner, sim.winner_area);
+				encode_winner(game, update);
+				save_record(game);
+			}
+			if (stepped && sim.tick % HASH_CHECK_INTERVAL == 0) {
+				encode_hash_check(sim, update);
+				game.hash_history[game.hash_checks % HASH_HISTORY] = std::make_pair(uint32_t(sim.tick), sim.board_hash());
+				game.hash_checks += 1;
+			}
+			sim.clear_changes();
 
-					if (player.x == game.powerup_x && player.y == game.powerup_y) {
-						game.powerup_timer = POWERUP_INTERVAL;
-						game.powerup_placed = false;
-					}
+			for (auto& it : game.players) {
+				//'y' + inputs + queued -- how many of this player's inputs the update reflects, and how many are
+				// still waiting (for their prediction and input pacing):
+				it.first->send('y');
+				it.first->send(it.second.inputs);
+				it.first->send(it.second.queued_count);
+				update.send(it.first);
+			}
+			count_message(false, 'y', 4, game.players.size());
+			size_t update_copies = game.players.size();
+			full.clear();
+			for (auto& s : game.spectators) {
+				if (game.falling_behind(s)) continue;
+				if (s.stale) {
+					if (full.empty()) encode_full(game, full);
+					full.send(s.connection);
+					full.count(1);
+					s.stale = false;
+				} else {
+					update.send(s.connection);
+					update_copies += 1;
 				}
 			}
+			update.count(update_copies);
 		}
 
-		//send updated game state to all clients in all games
-		for (auto& game : games) {
-			for (auto& it : game.players) {
-				auto& c = it.first;
-				c->send('a');
-				c->send(uint8_t(game.players.size()));
-				// send along all player info
-				for (auto& it_prime : game.players) {
-					auto& player_prime = it_prime.second;
-					c->send(uint8_t(player_prime.id));
-					c->send(uint8_t(player_prime.dir));
-					c->send(uint8_t(player_prime.x));
-					c->send(uint8_t(player_prime.y));
-				}
+		uint64_t overruns_before = scheduler.overrun_ticks;
+		scheduler.end_tick();
+
+		//update metrics (end_tick has already timed the tick and decided whether it overran):
+		tick_work_us.observe(scheduler.last_work_us);
+		ticks_total.add();
+		tick_overruns_total.add(scheduler.overrun_ticks - overruns_before);
+		{
+			int64_t players = 0, spectators = 0;
+			for (auto const &game : games) {
+				players += int64_t(game.players.size());
+				spectators += int64_t(game.spectators.size());
+			}
+			games_gauge.set(int64_t(games.size()));
+			players_gauge.set(players);
+			spectators_gauge.set(spectators);
+			queue_gauge.set(int64_t(matchmaker.size()));
+			connections_gauge.set(int64_t(server.connections.size()));
+			size_t unsent = 0, unsent_max = 0;
+			for (auto const &c : server.connections) {
+				unsent += c.send_buffer.size();
+				unsent_max = std::max(unsent_max, c.send_buffer.size());
 			}
+			send_buffer_gauge.set(int64_t(unsent));
+			send_buffer_max_gauge.set(int64_t(unsent_max));
+		}
+
+		//report tick timing about once a minute:
+		if (scheduler.ticks >= uint64_t(60.0 * scheduler.tick_rate())) {
+			Log::info("[tick] {}, {} timers pending", scheduler.stats_summary(), timers.pending);
+			Log::info("[matchmaking] {}", matchmaker.stats_summary());
+			scheduler.clear_stats();
+			matchmaker.clear_stats();
 		}
 	}
 	return 0;
 
 #ifdef _WIN32
 	} catch (std::exception const &e) {
+		Log::flush();
 		std::cerr << "Unhandled exception:\n" << e.what() << std::endl;
 		return 1;
 	} catch (...) {
+		Log::flush();
 		std::cerr << "Unhandled exception (unknown type)." << std::endl;
 		throw;
 	}
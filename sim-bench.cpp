@@ -0,0 +1,410 @@
+//sim-bench plays random games with GameSim as fast as it can and reports how many
+// ticks per second the simulation manages -- no window, GL context, audio or network
+// needed, so the rules can be profiled anywhere they compile.
+//
+//Every player is a bot that heads in a random direction for a few ticks at a time
+// (now and then stopping or taking a double step); the borders move out and powerups
+// appear on the server's schedule, and a bot now and then leaves.
+//
+//Games can be saved as match records (see MatchRecord.hpp) to re-run with ./replay.
+//
+//Captures are timed too (by wrapping the sim's kernels), along with the size of the box each one searched;
+// long games (e.g. --size 256x256 --players 8 --ticks 20000) show how that holds up as territories spread.
+//
+//Large boards (e.g. --size 4096x4096 --games 1 --ticks 200) are where the grid code's costs show:
+// besides ticks per second it reports how long setting up a board and a full state_hash() take.
+//
+//With --trail-len N it plays nothing, and instead times closing a loop around a trail of N tiles
+// (e.g. 50, 500, 5000 -- real trails stop at TRAIL_MAX_LEN + TRAIL_POWERUP_LEN, so it lays its own).
+//
+//With --check N it plays nothing, and instead cross-checks the capture fills (see GridKernels.cpp) on N
+// random boards: the scanline fill, the bitboard fill with and without its SIMD paths, and a plain
+// flood fill written here as the reference must all claim the same tiles.
+
+#include "MatchRecord.hpp"
+#include "GameSim.hpp"
+#include "Rng.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <iostream>
+#include <iomanip>
+#include <stdexcept>
+#include <filesystem>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <cmath>
+
+//same schedule as server.cpp:
+static constexpr uint32_t BorderInterval = 40; // ticks between border moves
+static constexpr uint32_t PowerupInterval = 100; // ticks between powerups
+
+//captures' fills, timed (sim.kernels points here while playing):
+static struct {
+	uint64_t count = 0;
+	uint64_t box_tiles = 0;
+	double seconds = 0.0;
+} fills;
+template< uint32_t (*GameSim::Kernels::*Fill)(GameSim &, uint8_t, GameSim::Box const &) >
+static uint32_t timed_fill(GameSim &sim, uint8_t id, GameSim::Box const &box) {
+	auto before = std::chrono::steady_clock::now();
+	uint32_t claimed = (GameSim::Kernels::get().*Fill)(sim, id, box);
+	fills.seconds += std::chrono::duration< double >(std::chrono::steady_clock::now() - before).count();
+	fills.count += 1;
+	fills.box_tiles += uint64_t(box.x1 - box.x0) * uint64_t(box.y1 - box.y0);
+	return claimed;
+}
+static GameSim::Kernels const timed_kernels = {
+	&timed_fill< &GameSim::Kernels::fill_interior >,
+	&timed_fill< &GameSim::Kernels::fill_interior_bits >,
+};
+
+//claim what fill_interior claims, the obvious way -- flood the box (plus a border of outside tiles)
+// from its corner, through anything that isn't id's territory, and claim the open tiles not reached:
+static uint32_t reference_fill(GameSim &sim, uint8_t id, GameSim::Box const &box) {
+	uint32_t const W = box.x1 - box.x0, H = box.y1 - box.y0, stride = W + 2;
+	auto open = [&](uint32_t x, uint32_t y) { // (in border-grid coordinates)
+		if (x == 0 || y == 0 || x == W + 1 || y == H + 1) return true;
+		uint32_t index = sim.index(uint16_t(box.x0 + x - 1), uint16_t(box.y0 + y - 1));
+		return !(sim.kinds[index] == GameSim::Tile::Territory && sim.owners[index] == id);
+	};
+	std::vector< bool > reached(stride * (H + 2), false);
+	std::vector< uint32_t > todo(1, 0);
+	reached[0] = true;
+	while (!todo.empty()) {
+		uint32_t at = todo.back();
+		todo.pop_back();
+		uint32_t x = at % stride, y = at / stride;
+		auto visit = [&](uint32_t nx, uint32_t ny) {
+			uint32_t n = ny * stride + nx;
+			if (!reached[n] && open(nx, ny)) {
+				reached[n] = true;
+				todo.emplace_back(n);
+			}
+		};
+		if (x > 0) visit(x - 1, y);
+		if (x + 1 < stride) visit(x + 1, y);
+		if (y > 0) visit(x, y - 1);
+		if (y + 1 < H + 2) visit(x, y + 1);
+	}
+	uint32_t claimed = 0;
+	for (uint32_t y = 1; y <= H; ++y) {
+		for (uint32_t x = 1; x <= W; ++x) {
+			if (open(x, y) && !reached[y * stride + x]) {
+				sim.set_tile(uint16_t(box.x0 + x - 1), uint16_t(box.y0 + y - 1), GameSim::Tile::Territory, id);
+				claimed++;
+			}
+		}
+	}
+	return claimed;
+}
+
+//run the fills on 'boards' random boards and boxes, returns the number where they disagreed:
+static uint32_t check_fills(uint32_t boards, uint64_t seed) {
+	Rng pick;
+	pick.seed(seed);
+	uint32_t mismatches = 0;
+	uint64_t claimed_total = 0;
+	for (uint32_t b = 0; b < boards; ++b) {
+		//sizes up to a few words wide (and some common ones), so rows end at every offset within a word:
+		uint16_t cols = uint16_t(GameSim::MinSize + pick.below(b % 10 == 0 ? 400 : 150));
+		uint16_t rows = uint16_t(GameSim::MinSize + pick.below(b % 10 == 0 ? 400 : 150));
+		if (b % 7 == 0) { cols = GameSim::DefaultCols; rows = GameSim::DefaultRows; }
+		if (b % 7 == 1) { cols = 128; rows = 128; }
+
+		//player 0's territory in one of a few patterns (with other players' territory sprinkled about):
+		uint32_t density = pick.below(100);
+		uint32_t style = pick.below(4);
+		std::vector< uint8_t > owner(uint32_t(cols) * rows, GameSim::NoOwner);
+		for (uint16_t y = 0; y < rows; ++y) {
+			for (uint16_t x = 0; x < cols; ++x) {
+				bool mine = false;
+				if (style == 0) { // noise
+					mine = pick.below(100) < density;
+				} else if (style == 1) { // diagonal stripes
+					mine = ((x / 3 + y / 5) % 4 == 0) || pick.below(100) < density / 4;
+				} else if (style == 2) { // nested rings with gaps
+					uint32_t d = uint32_t(std::max(std::abs(int(x) - cols / 2), std::abs(int(y) - rows / 2)));
+					mine = (d % 4 == 0 && !(d % 8 == 0 && x == cols / 2)) || (d % 8 == 4 && y == rows / 2 && x < cols / 2);
+				} else { // a grid of walls with holes
+					mine = (x % 7 == 0 || y % 5 == 0) && pick.below(100) >= density / 8;
+				}
+				if (mine) owner[y * cols + x] = 0;
+				else if (pick.below(20) == 0) owner[y * cols + x] = uint8_t(1 + pick.below(2));
+			}
+		}
+		GameSim::Box box;
+		if (b % 3 == 0) {
+			box.x0 = 0; box.y0 = 0; box.x1 = cols; box.y1 = rows;
+		} else {
+			box.x0 = uint16_t(pick.below(cols)); box.x1 = uint16_t(box.x0 + 1 + pick.below(cols - box.x0));
+			box.y0 = uint16_t(pick.below(rows)); box.y1 = uint16_t(box.y0 + 1 + pick.below(rows - box.y0));
+		}
+
+		auto fill = [&](uint32_t (*fn)(GameSim &, uint8_t, GameSim::Box const &), uint32_t *claimed) {
+			GameSim sim(cols, rows, GameSim::MinSize);
+			Rng rng;
+			rng.seed(b);
+			for (uint8_t id = 0; id < 3; ++id) sim.add_player(id, rng);
+			for (uint32_t i = 0; i < owner.size(); ++i) {
+				if (owner[i] != GameSim::NoOwner) sim.set_tile(uint16_t(i % cols), uint16_t(i / cols), GameSim::Tile::Territory, owner[i]);
+			}
+			sim.clear_changes();
+			*claimed = fn(sim, 0, box);
+			return sim.state_hash() ^ sim.board_hash();
+		};
+		uint32_t claimed[4];
+		uint64_t hashes[4] = {
+			fill(reference_fill, &claimed[0]),
+			fill(GameSim::Kernels::get().fill_interior, &claimed[1]),
+			fill(GameSim::Kernels::get().fill_interior_bits, &claimed[2]),
+			fill(GameSim::Kernels::scalar().fill_interior_bits, &claimed[3]),
+		};
+		claimed_total += claimed[0];
+		bool same = true;
+		for (uint32_t i = 1; i < 4; ++i) same = same && claimed[i] == claimed[0] && hashes[i] == hashes[0];
+		if (!same) {
+			mismatches += 1;
+			std::cout << "board " << b << " (" << cols << "x" << rows << ", pattern " << style << ", box " << box.x0 << "," << box.y0 << " - " << box.x1 << "," << box.y1
+				<< "): claimed " << claimed[0] << " (reference), " << claimed[1] << " (scanline), " << claimed[2] << " (bits), " << claimed[3] << " (bits, scalar)" << std::endl;
+		}
+	}
+#if defined(__AVX2__)
+	char const *simd = "with AVX2";
+#else
+	char const *simd = "without AVX2 (build with jam -sAVX2=1 to check those paths too)";
+#endif
+	std::cout << boards << " boards checked " << simd << ", " << claimed_total << " tiles claimed, " << mismatches << " mismatched." << std::endl;
+	return mismatches;
+}
+
+//time closing the loop around a trail of 'length' tiles (rounded up to even): the trail runs right along the
+// bottom row of a two-row rectangle and back left along the row above, and the player steps from its last
+// tile back onto its first, so the walk takes in the whole trail:
+static void time_trail_loop(uint32_t length) {
+	uint32_t half = (length + 1) / 2;
+	length = 2 * half;
+	GameSim sim(uint16_t(std::max< uint32_t >(GameSim::MinSize, half)), GameSim::MinSize, GameSim::MinSize);
+	Rng rng;
+	rng.seed(1);
+	sim.add_player(0, rng);
+
+	uint32_t capacity = 1;
+	while (capacity < length) capacity *= 2;
+	std::vector< GameSim::TrailEntry > entries(capacity);
+	for (uint32_t i = 0; i < length; ++i) {
+		uint16_t x = uint16_t(i < half ? i : length - 1 - i), y = uint16_t(i < half ? 0 : 1);
+		sim.set_tile(x, y, GameSim::Tile::Trail, 0);
+		entries[i] = GameSim::TrailEntry{sim.index(x, y), sim.births[sim.index(x, y)]};
+	}
+	GameSim::TrailRing ring{entries.data(), capacity - 1, 0, length};
+	uint32_t from = entries[length - 1].index, start = entries[0].index;
+
+	std::vector< uint32_t > loop(length);
+	uint32_t runs = std::max< uint32_t >(1, 4000000 / length);
+	auto before = std::chrono::steady_clock::now();
+	uint64_t walked = 0;
+	for (uint32_t r = 0; r < runs; ++r) {
+		walked += sim.trail_loop(0, ring, from, start, loop.data());
+	}
+	double seconds = std::chrono::duration< double >(std::chrono::steady_clock::now() - before).count();
+	if (walked != uint64_t(runs) * length) throw std::runtime_error("The loop around the trail wasn't found.");
+
+	std::cout << "Closing a loop around a trail of " << length << " tiles took " << std::fixed << std::setprecision(2)
+		<< seconds / runs * 1e6 << " us (" << runs << " runs)." << std::endl;
+}
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+	//when compiled on windows, unhandled exceptions don't have their message printed, which can make debugging simple issues difficult.
+	try {
+#endif
+
+	//------------ argument parsing ------------
+
+	uint32_t games = 20;
+	uint32_t players = 4;
+	uint32_t max_ticks = 2000;
+	uint16_t cols = GameSim::DefaultCols, rows = GameSim::DefaultRows;
+	uint64_t seed = 1;
+	uint32_t check = 0;
+	uint32_t trail_len = 0;
+	std::string save_dir;
+	bool usage = false;
+	for (int argi = 1; argi < argc; ++argi) {
+		std::string arg = argv[argi];
+		if (arg == "--games" && argi + 1 < argc) {
+			games = uint32_t(std::max(1, std::atoi(argv[argi + 1])));
+			argi += 1;
+		} else if (arg == "--players" && argi + 1 < argc) {
+			players = uint32_t(std::min(std::max(1, std::atoi(argv[argi + 1])), int(GameSim::MaxPlayers)));
+			argi += 1;
+		} else if (arg == "--ticks" && argi + 1 < argc) {
+			max_ticks = uint32_t(std::max(1, std::atoi(argv[argi + 1])));
+			argi += 1;
+		} else if (arg == "--size" && argi + 1 < argc) {
+			int c = 0, r = 0;
+			if (std::sscanf(argv[argi + 1], "%dx%d", &c, &r) != 2 || c < GameSim::MinSize || r < GameSim::MinSize || c > GameSim::MaxSize || r > GameSim::MaxSize) {
+				std::cerr << "Expecting a board size like 40x20 (each side " << GameSim::MinSize << " to " << GameSim::MaxSize << "), got '" << argv[argi + 1] << "'." << std::endl;
+				return 1;
+			}
+			cols = uint16_t(c);
+			rows = uint16_t(r);
+			argi += 1;
+		} else if (arg == "--seed" && argi + 1 < argc) {
+			seed = std::strtoull(argv[argi + 1], nullptr, 10);
+			argi += 1;
+		} else if (arg == "--check" && argi + 1 < argc) {
+			check = uint32_t(std::max(1, std::atoi(argv[argi + 1])));
+			argi += 1;
+		} else if (arg == "--trail-len" && argi + 1 < argc) {
+			trail_len = uint32_t(std::min(std::max(2, std::atoi(argv[argi + 1])), 2 * int(GameSim::MaxSize)));
+			argi += 1;
+		} else if (arg == "--save" && argi + 1 < argc) {
+			save_dir = argv[argi + 1];
+			argi += 1;
+		} else {
+			usage = true;
+		}
+	}
+	if (!usage && GameSim::start_size_for(players) > std::min(cols, rows)) {
+		std::cerr << players << " players need a board at least " << GameSim::start_size_for(players) << " tiles on a side." << std::endl;
+		return 1;
+	}
+	if (usage) {
+		std::cerr << "Usage:\n\t./sim-bench [--games N] [--players N] [--size CxR] [--ticks N] [--seed S] [--save dir]" << std::endl;
+		std::cerr << "\t(plays N random games of up to --ticks ticks each; --save writes them as .match files for ./replay)" << std::endl;
+		std::cerr << "\t./sim-bench --trail-len N" << std::endl;
+		std::cerr << "\t(times closing a loop around a trail of N tiles, up to " << 2 * GameSim::MaxSize << ")" << std::endl;
+		std::cerr << "\t./sim-bench --check N [--seed S]" << std::endl;
+		std::cerr << "\t(checks the capture fills against each other on N random boards)" << std::endl;
+		return 1;
+	}
+	if (check > 0) {
+		return (check_fills(check, seed) == 0 ? 0 : 1);
+	}
+	if (trail_len > 0) {
+		time_trail_loop(trail_len);
+		return 0;
+	}
+	if (save_dir != "") std::filesystem::create_directories(save_dir);
+
+	//------------ play ------------
+
+	typedef std::chrono::steady_clock Clock;
+	uint64_t total_ticks = 0;
+	double total_seconds = 0.0;
+	double setup_seconds = 0.0, state_hash_seconds = 0.0;
+	uint32_t wins = 0;
+
+	Rng pick; //the bots' choices (each game's own rng is seeded from this too)
+	pick.seed(seed);
+
+	for (uint32_t g = 0; g < games; ++g) {
+		MatchRecord record;
+		record.header.seed = (uint64_t(pick()) << 32) | pick();
+		record.header.game_id = g;
+		record.header.players = uint8_t(players);
+		record.header.start_size = GameSim::start_size_for(players);
+
+		Rng rng;
+		rng.seed(record.header.seed);
+		auto setting_up = Clock::now();
+		GameSim sim(cols, rows, record.header.start_size);
+		setup_seconds += std::chrono::duration< double >(Clock::now() - setting_up).count();
+		sim.kernels = &timed_kernels;
+
+		//bots walk for 'steps' ticks before choosing again:
+		std::vector< uint8_t > steps(players, 0);
+
+		auto before = Clock::now();
+		for (uint32_t id = 0; id < players; ++id) {
+			sim.add_player(uint8_t(id), rng);
+			record.add(sim.tick, MatchRecord::Event::Join, uint16_t(id));
+		}
+		while (sim.tick < max_ticks && !sim.game_over) {
+			if (sim.tick > 0 && sim.tick % BorderInterval == 0) {
+				uint16_t h = uint16_t(std::max(0, sim.horizontal_border - 1));
+				uint16_t v = uint16_t(std::max(0, sim.vertical_border - 1));
+				sim.set_borders(h, v);
+				record.add(sim.tick, MatchRecord::Event::Borders, h, v);
+			}
+			if (sim.tick % PowerupInterval == PowerupInterval / 2) {
+				sim.place_powerup(rng);
+				record.add(sim.tick, MatchRecord::Event::Powerup);
+			}
+			for (uint32_t id = 0; id < players; ++id) {
+				if (!sim.players[id].active) continue;
+				if (steps[id] == 0) {
+					uint32_t roll = pick.below(20);
+					GameSim::Dir dir = GameSim::Dir(roll == 0 ? GameSim::none : roll == 1 ? GameSim::ll + pick.below(4) : pick.below(4));
+					if (dir != sim.players[id].dir) {
+						sim.set_input(uint8_t(id), dir);
+						record.add(sim.tick, MatchRecord::Event::Input, uint16_t(id), uint16_t(dir));
+					}
+					steps[id] = uint8_t(1 + pick.below(6));
+				}
+				steps[id] -= 1;
+			}
+			if (pick.below(1000) == 0) {
+				uint32_t id = pick.below(players);
+				if (sim.players[id].active) {
+					sim.remove_player(uint8_t(id));
+					record.add(sim.tick, MatchRecord::Event::Leave, uint16_t(id));
+				}
+			}
+			sim.clear_changes();
+			sim.step();
+		}
+		sim.clear_changes();
+		double seconds = std::chrono::duration< double >(Clock::now() - before).count();
+
+		auto hashing = Clock::now();
+		volatile uint64_t hash = sim.state_hash(); // (volatile, so it isn't optimized away)
+		(void)hash;
+		state_hash_seconds += std::chrono::duration< double >(Clock::now() - hashing).count();
+
+		total_seconds += seconds;
+		total_ticks += sim.tick;
+		if (sim.game_over) wins += 1;
+
+		std::cout << "game " << g << ": " << sim.tick << " ticks, " << record.event_count << " events, "
+			<< (sim.game_over ? "won by player " + std::to_string(int(sim.winner)) : std::string("no winner")) << ", "
+			<< std::fixed << std::setprecision(2) << seconds * 1e3 << " ms ("
+			<< std::setprecision(0) << (seconds > 0.0 ? sim.tick / seconds : 0.0) << " ticks/s)" << std::endl;
+
+		if (save_dir != "") {
+			record.finish(sim);
+			char name[32];
+			std::snprintf(name, sizeof(name), "game-%04u.match", g);
+			record.save((std::filesystem::path(save_dir) / name).string());
+		}
+	}
+
+	std::cout << games << " games of " << players << " players on " << cols << "x" << rows << ", " << wins << " won";
+	if (total_seconds > 0.0) {
+		std::cout << ", " << total_ticks << " ticks in " << std::setprecision(3) << total_seconds << " s ("
+			<< std::setprecision(0) << total_ticks / total_seconds << " ticks/s)";
+	}
+	std::cout << "." << std::endl;
+	std::cout << "Setting up a board took " << std::setprecision(2) << setup_seconds / games * 1e3 << " ms, a full state_hash() "
+		<< state_hash_seconds / games * 1e3 << " ms." << std::endl;
+	if (fills.count > 0) {
+		std::cout << fills.count << " captures searched " << std::setprecision(0) << double(fills.box_tiles) / fills.count << " tiles each on average, "
+			<< std::setprecision(2) << fills.seconds / fills.count * 1e6 << " us per fill (" << std::setprecision(1) << 100.0 * fills.seconds / total_seconds << "% of the time)." << std::endl;
+	}
+
+	return 0;
+
+#ifdef _WIN32
+	} catch (std::exception const &e) {
+		std::cerr << "Unhandled exception:\n" << e.what() << std::endl;
+		return 1;
+	} catch (...) {
+		std::cerr << "Unhandled exception (unknown type)." << std::endl;
+		throw;
+	}
+#endif
+}
@@ -0,0 +1,226 @@
+//spectator-load attaches a crowd of spectators to one game on a running server and reports
+// what they cost it: work per tick (from the server's metrics port) and memory per spectator
+// (from the growth of the server's resident size, where /proc has it -- pass --pid).
+//
+//It first queues up bot players until the server starts a game (the bots turn at random
+// now and then, so the board keeps changing), measures for a while with nobody watching,
+// then connects the spectators and measures again. For example:
+//
+//   dist/server 1337 10 2 9100 &
+//   dist/spectator-load --port 1337 --metrics-port 9100 --spectators 1000 --pid $!
+//
+//NOTE: Connection polls with select(), so neither the server nor this can have many more
+// than FD_SETSIZE (usually 1024) sockets open -- 1000 spectators is about as far as it goes.
+
+#include "Connection.hpp"
+#include "Rng.hpp"
+
+#include <chrono>
+#include <thread>
+#include <cstdlib>
+#include <cstdio>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <list>
+#include <map>
+#include <optional>
+#include <algorithm>
+#include <string>
+
+//Client's constructor reports each connection on std::cout; that's a lot of noise for a thousand of them:
+template< typename F >
+static void quietly(F const &connect) {
+	std::cout.setstate(std::ios::failbit);
+	connect();
+	std::cout.clear();
+}
+
+//everything the server's metrics port says, by name (labels included):
+static std::map< std::string, double > scrape(std::string const &host, std::string const &port) {
+	std::optional< Client > client;
+	quietly([&](){ client.emplace(host, port); });
+	client->connection.send_raw("metrics\n", 8);
+	auto give_up = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+	while (client->connection && std::chrono::steady_clock::now() < give_up) {
+		client->poll(nullptr, 0.1); // (the server closes the connection once the metrics are sent)
+	}
+	std::map< std::string, double > metrics;
+	std::istringstream lines(std::string(client->connection.recv_buffer.begin(), client->connection.recv_buffer.end()));
+	std::string line;
+	while (std::getline(lines, line)) {
+		if (line.empty() || line[0] == '#') continue;
+		size_t space = line.rfind(' ');
+		if (space == std::string::npos) continue;
+		metrics[line.substr(0, space)] = std::atof(line.c_str() + space + 1);
+	}
+	return metrics;
+}
+
+//the resident size of process 'pid' in bytes (0 if unknown -- e.g., no /proc):
+static uint64_t resident_bytes(std::string const &pid) {
+	if (pid.empty()) return 0;
+	std::ifstream status("/proc/" + pid + "/status");
+	std::string line;
+	while (std::getline(status, line)) {
+		if (line.compare(0, 6, "VmRSS:") == 0) return uint64_t(std::atoll(line.c_str() + 6)) * 1024;
+	}
+	return 0;
+}
+
+//difference in a metric between two scrapes:
+static double delta(std::map< std::string, double > const &before, std::map< std::string, double > const &after, std::string const &name) {
+	auto b = before.find(name), a = after.find(name);
+	return (a == after.end() ? 0.0 : a->second) - (b == before.end() ? 0.0 : b->second);
+}
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+	//when compiled on windows, unhandled exceptions don't have their message printed, which can make debugging simple issues difficult.
+	try {
+#endif
+
+	//------------ argument parsing ------------
+
+	std::string host = "localhost";
+	std::string port, metrics_port;
+	uint32_t spectator_count = 1000;
+	double seconds = 10.0;
+	std::string pid;
+	bool usage = false;
+	for (int argi = 1; argi < argc; ++argi) {
+		std::string arg = argv[argi];
+		if (arg == "--host" && argi + 1 < argc) {
+			host = argv[argi + 1];
+			argi += 1;
+		} else if (arg == "--port" && argi + 1 < argc) {
+			port = argv[argi + 1];
+			argi += 1;
+		} else if (arg == "--metrics-port" && argi + 1 < argc) {
+			metrics_port = argv[argi + 1];
+			argi += 1;
+		} else if (arg == "--spectators" && argi + 1 < argc) {
+			spectator_count = uint32_t(std::max(1, std::atoi(argv[argi + 1])));
+			argi += 1;
+		} else if (arg == "--seconds" && argi + 1 < argc) {
+			seconds = std::max(1.0, std::atof(argv[argi + 1]));
+			argi += 1;
+		} else if (arg == "--pid" && argi + 1 < argc) {
+			pid = argv[argi + 1];
+			argi += 1;
+		} else {
+			usage = true;
+		}
+	}
+	if (usage || port.empty() || metrics_port.empty()) {
+		std::cerr << "Usage:\n\t./spectator-load --port P --metrics-port M [--host localhost] [--spectators 1000] [--seconds 10] [--pid server-pid]" << std::endl;
+		std::cerr << "\t(the server must be running with its metrics port on; --pid lets memory per spectator be measured, where /proc exists)" << std::endl;
+		return 1;
+	}
+
+	//------------ load ------------
+
+	std::list< Client > players, spectators;
+	uint64_t spectator_bytes = 0;
+	Rng rng;
+	rng.seed(1);
+
+	//keep everyone's connection drained, with the bots turning now and then, for 'duration' seconds (at least one pass):
+	auto run = [&](double duration) {
+		auto until = std::chrono::steady_clock::now() + std::chrono::duration< double >(duration);
+		do {
+			for (auto &player : players) {
+				player.poll([](Connection *c, Connection::Event evt) {
+					if (evt == Connection::OnRecv) c->recv_buffer.clear();
+				});
+				if (rng.below(50) == 0) {
+					player.connection.send('b');
+					player.connection.send(uint8_t(rng.below(4)));
+				}
+			}
+			for (auto &spectator : spectators) {
+				spectator.poll([&](Connection *c, Connection::Event evt) {
+					if (evt != Connection::OnRecv) return;
+					spectator_bytes += c->recv_buffer.size();
+					c->recv_buffer.clear();
+				});
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+		} while (std::chrono::steady_clock::now() < until);
+	};
+
+	//queue players until the server starts a game with them:
+	auto started = scrape(host, metrics_port)["server_games"];
+	while (scrape(host, metrics_port)["server_games"] <= started) {
+		if (players.size() == 128) throw std::runtime_error("Queued 128 players and no game started.");
+		quietly([&](){ players.emplace_back(host, port); });
+		players.back().connection.send('q');
+		run(0.2);
+	}
+	std::cout << "Game started with " << players.size() << " bot players; waiting out the countdown." << std::endl;
+	run(4.0);
+
+	struct Sample {
+		double work_us = 0.0; // per tick
+		double ticks = 0.0;
+		uint64_t resident = 0;
+		std::map< std::string, double > metrics;
+	};
+	auto measure = [&]() {
+		Sample sample;
+		auto before = scrape(host, metrics_port);
+		run(seconds);
+		sample.metrics = scrape(host, metrics_port);
+		sample.resident = resident_bytes(pid);
+		sample.ticks = delta(before, sample.metrics, "server_ticks_total");
+		if (sample.ticks > 0) sample.work_us = delta(before, sample.metrics, "server_tick_work_us_sum") / sample.ticks;
+		return sample;
+	};
+
+	Sample alone = measure();
+
+	auto connecting = std::chrono::steady_clock::now();
+	for (uint32_t i = 0; i < spectator_count; ++i) {
+		quietly([&](){ spectators.emplace_back(host, port); });
+		spectators.back().connection.send('v');
+		spectators.back().connection.send(uint32_t(0)); // (the newest game -- the bots')
+		if (i % 4 == 3) run(0.0); // (the server's listen backlog is short, so let it catch up with accepting)
+	}
+	double connect_seconds = std::chrono::duration< double >(std::chrono::steady_clock::now() - connecting).count();
+	run(2.0); // (everyone gets the whole board first)
+
+	auto resyncs_before = scrape(host, metrics_port)["server_messages_out_total{type=\"m\"}"];
+	spectator_bytes = 0;
+	Sample watched = measure();
+
+	//------------ report ------------
+
+	std::cout << std::fixed << std::setprecision(2);
+	std::cout << "Connected " << spectators.size() << " spectators in " << connect_seconds << " s; the server counts "
+		<< watched.metrics["server_spectators"] << " watching." << std::endl;
+	std::cout << "Work per tick: " << alone.work_us << " us without spectators, " << watched.work_us << " us with them ("
+		<< (watched.work_us - alone.work_us) / spectators.size() << " us per spectator; over " << alone.ticks << " and " << watched.ticks << " ticks)." << std::endl;
+	std::cout << "Each spectator received " << spectator_bytes / spectators.size() / seconds << " bytes/s; "
+		<< watched.metrics["server_messages_out_total{type=\"m\"}"] - resyncs_before << " whole boards were resent to spectators that fell behind." << std::endl;
+	if (alone.resident && watched.resident) {
+		std::cout << "Server resident size: " << alone.resident / 1024 << " KiB without spectators, " << watched.resident / 1024 << " KiB with them ("
+			<< (double(watched.resident) - double(alone.resident)) / spectators.size() << " bytes per spectator)." << std::endl;
+	} else {
+		std::cout << "(Pass the server's --pid, on a system with /proc, to measure memory per spectator.)" << std::endl;
+	}
+	std::cout << "Largest send backlog at the end: " << watched.metrics["server_send_buffer_max_bytes"] << " bytes." << std::endl;
+
+	return 0;
+
+#ifdef _WIN32
+	} catch (std::exception const &e) {
+		std::cerr << "Unhandled exception:\n" << e.what() << std::endl;
+		return 1;
+	} catch (...) {
+		std::cerr << "Unhandled exception (unknown type)." << std::endl;
+		throw;
+	}
+#endif
+}